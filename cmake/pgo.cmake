@@ -0,0 +1,82 @@
+# Profile-guided build of libchip8 and the gain it brings, run from the source tree:
+#
+#   cmake [-DBUILD_DIR=_pgo] [-DCONFIGURE_ARGS="-G;Ninja"] -P cmake/pgo.cmake
+#
+# BUILD_DIR/plain is a Release build for reference. BUILD_DIR/pgo is configured with
+# CHIP8_PGO=GENERATE, trained on the ROM corpus (chip8-train), then reconfigured with CHIP8_PGO=USE
+# and rebuilt. Both run the corpus macrobenchmarks into plain.json and pgo.json, and the change of
+# every benchmark is printed. The training sessions are deterministic, so the profile and the
+# code built from it are the same on every run; only the timings vary.
+
+cmake_minimum_required(VERSION 3.9)
+
+get_filename_component(SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if(NOT BUILD_DIR)
+	set(BUILD_DIR "${SOURCE_DIR}/_pgo")
+endif()
+get_filename_component(BUILD_DIR "${BUILD_DIR}" ABSOLUTE)
+
+# the core and what measures it; the frontend needs its own libraries
+set(PGO_TARGETS chip8 chip8-shared chip8-bench)
+
+function(run_checked)
+	execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		string(REPLACE ";" " " command "${ARGN}")
+		message(FATAL_ERROR "Failed: ${command}")
+	endif()
+endfunction()
+
+function(configure_tree tree)
+	file(MAKE_DIRECTORY ${tree})
+	execute_process(COMMAND ${CMAKE_COMMAND} ${CONFIGURE_ARGS} -DCMAKE_BUILD_TYPE=Release ${ARGN} ${SOURCE_DIR}
+		WORKING_DIRECTORY ${tree} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "Configuring ${tree} failed")
+	endif()
+endfunction()
+
+function(build_tree tree)
+	foreach(target ${ARGN})
+		run_checked(${CMAKE_COMMAND} --build ${tree} --config Release --target ${target})
+	endforeach()
+endfunction()
+
+# chip8-bench of a tree, with single- or multi-configuration generators
+function(find_bench tree variable)
+	foreach(candidate src/chip8-bench src/Release/chip8-bench src/chip8-bench.exe src/Release/chip8-bench.exe)
+		if(EXISTS ${tree}/${candidate})
+			set(${variable} ${tree}/${candidate} PARENT_SCOPE)
+			return()
+		endif()
+	endforeach()
+	message(FATAL_ERROR "No chip8-bench in ${tree}")
+endfunction()
+
+message(STATUS "Reference build in ${BUILD_DIR}/plain")
+configure_tree(${BUILD_DIR}/plain -DCHIP8_PGO=OFF)
+build_tree(${BUILD_DIR}/plain ${PGO_TARGETS})
+
+message(STATUS "Instrumented build and training in ${BUILD_DIR}/pgo")
+configure_tree(${BUILD_DIR}/pgo -DCHIP8_PGO=GENERATE)
+build_tree(${BUILD_DIR}/pgo ${PGO_TARGETS} chip8-train)
+
+message(STATUS "Build with the profile and LTO in ${BUILD_DIR}/pgo")
+configure_tree(${BUILD_DIR}/pgo -DCHIP8_PGO=USE)
+build_tree(${BUILD_DIR}/pgo ${PGO_TARGETS})
+
+message(STATUS "Corpus macrobenchmarks, reference then profile-guided")
+find_bench(${BUILD_DIR}/plain plainBench)
+find_bench(${BUILD_DIR}/pgo pgoBench)
+execute_process(COMMAND ${plainBench} --filter=macro/ --json OUTPUT_FILE ${BUILD_DIR}/plain.json RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "The reference chip8-bench failed")
+endif()
+
+# the comparison goes to stderr; slower benchmarks are reported, not fatal
+execute_process(COMMAND ${pgoBench} --filter=macro/ --json --baseline=${BUILD_DIR}/plain.json
+	OUTPUT_FILE ${BUILD_DIR}/pgo.json RESULT_VARIABLE result)
+if(NOT result EQUAL 0 AND NOT result EQUAL 2)
+	message(FATAL_ERROR "The profile-guided chip8-bench failed")
+endif()
+message(STATUS "Libraries with the profile applied: ${BUILD_DIR}/pgo/src")
@@ -1,76 +1,330 @@
 // Chip 8 class abstraction
 // the size of variables are taken according to the official Chip 8 technical documentation
 
+#pragma once
+#include "chip8_quirks.h"
+#include "chip8_log.h"
+#include "chip8_audio.h"
 #include <cstdint>
+#include <cstddef>
+#include <vector>
 
 #define FONTSET_SIZE 80
-#define MEMORY_SIZE 4096
+#define BIG_FONTSET_ADDRESS 0x0050  // SUPER-CHIP 8x10 digits, right after the 4x5 font
+#define BIG_FONTSET_SIZE 100
+#define MEMORY_SIZE 65536           // XO-CHIP address space; the other profiles address the first 4 KB
+#define MEMORY_MASK (MEMORY_SIZE - 1)
 #define REGS_NUMBER 16
-#define GRAPHICS_PIXEL_RESOL 64 * 32
-#define DISPLAY_HEIGHT_PIXELS 64
+#define RPL_FLAGS_NUMBER 16
+#define MEMORY_PAGE_SIZE 64
+#define MEMORY_PAGES (MEMORY_SIZE / MEMORY_PAGE_SIZE)
 #define STACK_LEVELS 16
 #define KEYS_NUMBER 16
 
+// display: 64x32 (low resolution) or 128x64 (SUPER-CHIP high resolution), in up to two XO-CHIP
+// bit planes; every row is bit-packed into two 64-bit words, the leftmost pixel in the top bit
+#define DISPLAY_LORES_WIDTH 64
+#define DISPLAY_LORES_HEIGHT 32
+#define DISPLAY_HIRES_WIDTH 128
+#define DISPLAY_HIRES_HEIGHT 64
+#define DISPLAY_ROW_WORDS 2
+#define DISPLAY_PLANES 2
+#define AUDIO_PATTERN_SIZE 16
 
-class chip8
+#define CHIP8_DEFAULT_SEED 1        // CXNN seed of a freshly loaded machine; seedRandom() picks another
+
+#define SPRITE_CACHE_ENTRIES 256
+#define SPRITE_MAX_HEIGHT 16
+
+// most instructions one executeCycle() can retire (the 6XNN 6YNN DXYN superinstruction)
+#define FUSED_MAX_INSTRUCTIONS 3
+
+class chip8IR;
+class chip8;
+
+// what the interpreter does on an opcode it does not know
+enum unknownOpcodePolicy
 {
-private:
+    UNKNOWN_OPCODE_HALT,    // stop executing until the next load or reset; the default
+    UNKNOWN_OPCODE_SKIP,    // treat it as a 2-byte no-op
+    UNKNOWN_OPCODE_TRAP     // ask the trap handler; it returns true to skip the opcode, false to halt
+};
 
-    uint8_t fontset[FONTSET_SIZE] = 
-    {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
+typedef bool (*unknownOpcodeHandler)(const chip8& c8, uint16_t address, uint16_t opcode, void* context);
+
+// DXYN sprite pre-shifted by (x mod 64): each row is two 64-bit words that are XORed into the
+// display row at a word boundary
+struct spriteCacheEntry
+{
+    uint16_t address;   // start of the sprite data
+    uint8_t height;     // rows; 0 marks an empty entry
+    uint8_t shift;      // x mod 64
+    uint8_t wide;       // 16 pixels wide (DXY0) instead of 8
+    uint32_t version;   // sum of the versions of the pages the rows were read from
+    uint64_t rows[SPRITE_MAX_HEIGHT][2];
+};
+
+// superinstruction starting at an address (see chip8::executeFused), matched on the first visit
+enum fusionKind : uint8_t
+{
+    FUSION_UNMATCHED,   // not looked at since the bytes were last written
+    FUSION_NONE,
+    FUSION_SET_PAIR,    // 6XNN 6YNN
+    FUSION_SET_DRAW,    // 6XNN 6YNN DXYN
+    FUSION_COUNT_TEST,  // 7XNN 3XNN
+    FUSION_SPRITE,      // ANNN DXYN
+    FUSION_POLL_DELAY   // FX07 3X00
+};
+
+struct spriteCache
+{
+    spriteCacheEntry entries[SPRITE_CACHE_ENTRIES];
+
+    // bumped by every store into the page, which makes entries built from it stale
+    uint32_t pageVersion[MEMORY_PAGES];
+};
+
+// Complete machine state as one POD block, so a snapshot is a single copy. The first cache line
+// holds everything a typical instruction touches; memory and the display follow, each starting on
+// its own cache line. The fontset lives in shared read-only data (see chip8.cpp).
+struct alignas(64) chip8State
+{
+    // additional registers
+    uint16_t pc;    // program counter
+    uint16_t I;     // index register
 
     // to store opcode
     uint16_t opcode;
 
-    // memory
-    uint8_t memory[MEMORY_SIZE];
-
     // general-purpose registers
     uint8_t V[REGS_NUMBER];
 
-    // additional registers
-    uint16_t I;     // index register
-    uint16_t pc;    // program counter
+    // on which level of stack we are now
+    uint8_t stackLevel;
 
     // timers
     uint8_t delayTimer;
     uint8_t soundTimer;
 
-    // 16 stack levels and each stores an address to return to; stackLevel - on which level of stack we are now.
-    uint16_t stack[STACK_LEVELS];
-    uint8_t stackLevel;
+    // FX0A halts the CPU until a key is pressed; the key index is then stored in V[keyWaitRegister]
+    bool waitingForKey;
+    uint8_t keyWaitRegister;
+
+    // stopped by an unknown opcode or 00FD
+    bool halted;
 
-public:
     bool drawFlag;
 
-    // graphics; monochrome 64x32 pixels screen
-    uint8_t displayScreen[GRAPHICS_PIXEL_RESOL];
-    
+    // SUPER-CHIP 128x64 mode (00FF) and the XO-CHIP bit planes drawn to (FN01)
+    bool hires;
+    uint8_t planeMask;
+
+    // xorshift32 state for CXNN; kept per instance so that a run is reproducible from its seed
+    uint32_t randomState;
+
+    // bit r - display row r was changed since clearDirtyPages()
+    uint64_t dirtyDisplayRows;
+
+    // dynamic instruction counts; fusedInstructions - how many of them ran inside a superinstruction
+    uint64_t executedInstructions;
+    uint64_t fusedInstructions;
+
+    // 16 stack levels and each stores an address to return to
+    uint16_t stack[STACK_LEVELS];
+
     // input keys
     uint8_t key[KEYS_NUMBER];
 
+    // EX9E/EXA1 executed and FX0A waits satisfied since the load; lets hosts see when input was consumed
+    uint32_t keyReads;
+
+    // SUPER-CHIP RPL user flags (FX75 / FX85)
+    uint8_t rplFlags[RPL_FLAGS_NUMBER];
+
+    // XO-CHIP 1-bit sample pattern (F002) and its playback pitch (FX3A)
+    uint8_t audioPattern[AUDIO_PATTERN_SIZE];
+    uint8_t pitch;
+    bool audioPatternLoaded;    // the buzzer plays until the program loads a pattern
+
+    // bit p - memory page p was written since clearDirtyPages()
+    uint64_t dirtyPages[(MEMORY_PAGES + 63) / 64];
+
+    // graphics; only the top-left 64x32 pixels and the first word of every row are used in low resolution
+    alignas(64) uint64_t display[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT][DISPLAY_ROW_WORDS];
+
+    // memory
+    uint8_t memory[MEMORY_SIZE];
+};
+
+static_assert(offsetof(chip8State, fusedInstructions) + sizeof(uint64_t) <= 64, "hot registers must fit in one cache line");
+
+class chip8 : private chip8State
+{
+    friend class chip8IR;
+
+private:
+    // micro-op IR and its block cache; created on the first executeBlock()
+    chip8IR* ir;
+
+    // pre-shifted DXYN sprites; created on the first draw
+    spriteCache* sprites;
+
+    // fusionKind of every addressable byte; created on the first cycle
+    uint8_t* fusionKinds;
+
+    // quirk profile and the interpreter specialized for it (see setQuirkProfile); memoryMask + 1
+    // bytes of memory are addressable, and only those are cleared, copied and hashed
+    quirkProfile quirks;
+    uint16_t memoryMask;
+    void (chip8::*cycleFn)(int budget);
+    void (chip8::*opcodeFn)();
+
+    // diagnostics go to the logger, if any; the core writes nothing itself
+    chip8Logger* logger;
+    unknownOpcodePolicy unknownPolicy;
+    unknownOpcodeHandler unknownHandler;
+    void* unknownHandlerContext;
+
+    // sample generator fed by tickTimers; not owned, NULL for silent instances
+    chip8Audio* audio;
+
+    // pages and display rows changed since the last reset() or loadROM that the public dirty bits
+    // no longer show: clearDirtyPages() and rewindState() move them here, and only reset() and
+    // loadROM clear them
+    uint64_t resetPages[(MEMORY_PAGES + 63) / 64];
+    uint64_t resetDisplayRows;
+
+    uint8_t nextRandom()
+    {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return (uint8_t)(randomState >> 24);
+    }
+
+    void resetRegisters();
+    template <class Quirks> void executeCycleFor(int budget);
+    template <class Quirks> void executeOpcodeFor();
+    template <class Quirks> bool executeFused(int budget);
+    uint8_t matchFusion(uint16_t address) const;
+    void executeOpcode() { (this->*opcodeFn)(); }
+    void onUnknownOpcode();
+    void skipNextInstruction();
+    bool isLongInstruction(uint16_t address) const
+    {
+        return memory[address & memoryMask] == 0xF0 && memory[(address + 1) & memoryMask] == 0x00;
+    }
+    int getMemoryPageWords() const { return (memoryMask + 1) / MEMORY_PAGE_SIZE / 64; }
+    void markMemoryDirty();
+    void clearResetPages();
+    void clearDisplay();
+    void setResolution(bool highResolution);
+    void scrollDisplay(int rowsDown, int pixelsRight);
+    template <bool Wrap> void drawSprite(uint8_t regNumberX, uint8_t regNumberY, uint8_t height);
+    const spriteCacheEntry& getCachedSprite(uint16_t address, uint8_t height, uint8_t shift, bool wide);
+    void onMemoryWrite(uint16_t address, uint16_t length);
+    void invalidatePage(int page);
+    void invalidateCaches();
+
 public:
-    chip8() { }
-    ~chip8() { }
+    using chip8State::drawFlag;
+    using chip8State::key;
+
+public:
+    // without a logger the diagnostics are off; frontends pass &getDefaultLogger() (chip8_logsink.h)
+    chip8() : chip8(NULL) { }
+
+    explicit chip8(chip8Logger* initialLogger) : ir(NULL), sprites(NULL), fusionKinds(NULL), logger(initialLogger),
+        unknownPolicy(UNKNOWN_OPCODE_HALT), unknownHandler(NULL), unknownHandlerContext(NULL), audio(NULL),
+        resetPages(), resetDisplayRows(0)
+    {
+        setQuirkProfile(QUIRKS_MODERN);
+    }
+    ~chip8();
+
+    chip8(const chip8&) = delete;
+    chip8& operator=(const chip8&) = delete;
 
     void initialize();
-    bool loadGame(const char* gameFileName);
-    void executeCycle();
+    bool loadROM(const uint8_t* data, size_t size);
+
+    // selects the opcode semantics of a CHIP-8 variant; normally called before loading the ROM
+    void setQuirkProfile(quirkProfile profile);
+    quirkProfile getQuirkProfile() const { return quirks; }
+
+    void setLogger(chip8Logger& newLogger) { logger = &newLogger; }
+    void setAudio(chip8Audio* newAudio) { audio = newAudio; }
+    void setUnknownOpcodePolicy(unknownOpcodePolicy policy, unknownOpcodeHandler handler = NULL, void* context = NULL)
+    {
+        unknownPolicy = policy;
+        unknownHandler = handler;
+        unknownHandlerContext = context;
+    }
+
+    // fast reset to a post-load memory image, proportional to the pages and rows changed since the
+    // load or the previous reset, whether or not clearDirtyPages() was called in between
+    void reset(const uint8_t* pristineMemory, uint32_t seed);
+    void seedRandom(uint32_t seed);
+
+    // getMemorySize() bytes: 4 KB, or 64 KB for XO-CHIP; the rest of the state's memory is unused
+    const uint8_t* getMemory() const { return memory; }
+    size_t getMemorySize() const { return (size_t)memoryMask + 1; }
+
+    // snapshots: the registers, the display and the addressable memory are copied as one block; the
+    // caches are rebuilt after a load. Both machines must use the same quirk profile.
+    const chip8State& getState() const { return *this; }
+    void saveState(chip8State& snapshot) const;
+    void loadState(const chip8State& snapshot);
+
+    // loadState for a snapshot whose memory equals this machine's as of the last clearDirtyPages(),
+    // except for the pages set in otherPages (MEMORY_PAGES bits): copies the registers and display
+    // but only the dirty and the given pages, then clears the dirty bits
+    void rewindState(const chip8State& snapshot, const uint64_t* otherPages = NULL);
+
+    // executes one instruction, or a fused pair/triple of them (see executeFused), retiring at
+    // most budget instructions
+    void executeCycle(int budget = FUSED_MAX_INSTRUCTIONS) { (this->*cycleFn)(budget); }
+
+    // executes cycles until count instructions have retired or the CPU stops (FX0A or halted);
+    // returns the number retired. Frame loops use this rather than counting executeCycle() calls.
+    uint64_t executeInstructions(uint64_t count);
+
+    // runs one basic block through the optimizing micro-op IR (experimental, see chip8_ir.h); returns the
+    // number of instructions retired
+    int executeBlock();
+
+    // decrements delay and sound timers and renders one frame of audio; the host calls it at 60 Hz,
+    // independently of executeCycle
+    void tickTimers();
+
+    // key transition from the host; a press releases the CPU from FX0A
+    void setKey(uint8_t keyIndex, bool pressed);
+
+    int getDisplayWidth() const { return hires ? DISPLAY_HIRES_WIDTH : DISPLAY_LORES_WIDTH; }
+    int getDisplayHeight() const { return hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_LORES_HEIGHT; }
+
+    // bit-packed row y of a plane, DISPLAY_ROW_WORDS words
+    const uint64_t* getDisplayRow(int plane, int y) const { return display[plane][y]; }
+
+    // color of the pixel at (x, y) in the current resolution: bit p is set if it is lit in plane p
+    uint8_t getPixel(int x, int y) const
+    {
+        uint8_t color = 0;
+        for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+            color |= ((display[plane][y][x / 64] >> (63 - x % 64)) & 1) << plane;
+        return color;
+    }
+
+    bool isWaitingForKey() const { return waitingForKey; }
+    bool isHalted() const { return halted; }
+    bool areTimersActive() const { return delayTimer > 0 || soundTimer > 0; }
+    uint32_t getKeyReads() const { return keyReads; }
+
+    bool isPageDirty(int page) const { return (dirtyPages[page / 64] >> (page % 64)) & 1; }
+    const uint64_t* getDirtyPages() const { return dirtyPages; }
+    uint64_t getDirtyDisplayRows() const { return dirtyDisplayRows; }
+    void clearDirtyPages();
+
+    uint64_t getExecutedInstructions() const { return executedInstructions; }
+    uint64_t getFusedInstructions() const { return fusedInstructions; }
 };
@@ -0,0 +1,84 @@
+// Sound output. chip8::tickTimers renders one 60 Hz frame of samples at a time into a
+// single-producer/single-consumer ring buffer; the host moves them to a sink with pump().
+// Samples are signed 16-bit mono.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+#define AUDIO_DEFAULT_SAMPLE_RATE 44100
+#define AUDIO_RING_CAPACITY 16384       // samples; power of two
+#define AUDIO_TONE_FREQUENCY 440        // square wave of the classic buzzer
+#define AUDIO_FRAMES_PER_SECOND 60
+
+// lock-free SPSC queue of samples
+class audioRingBuffer
+{
+private:
+    std::vector<int16_t> samples;
+    size_t mask;
+
+    // on separate cache lines so the producer and the consumer do not share one
+    alignas(64) std::atomic<size_t> writePosition;
+    alignas(64) std::atomic<size_t> readPosition;
+
+public:
+    explicit audioRingBuffer(size_t capacity);
+
+    // producer side; returns how many samples fit
+    size_t write(const int16_t* data, size_t count);
+
+    // consumer side; returns how many samples were read
+    size_t read(int16_t* data, size_t count);
+
+    size_t available() const { return writePosition.load(std::memory_order_acquire) - readPosition.load(std::memory_order_acquire); }
+};
+
+// where pump() delivers the samples; the file and device sinks of the frontends are in chip8_audio_out.h
+class audioSink
+{
+public:
+    virtual ~audioSink() { }
+
+    // consumer side: samples taken from the ring buffer
+    virtual void write(const int16_t* samples, size_t count) = 0;
+};
+
+// discards everything; for runs without audio
+class nullAudioSink : public audioSink
+{
+public:
+    void write(const int16_t*, size_t) { }
+};
+
+// Sample generator. The buzzer is a square wave; an XO-CHIP program that loaded a pattern (F002)
+// plays its 128 bits in a loop at 4000 * 2^((pitch - 64) / 48) bits per second.
+class chip8Audio
+{
+private:
+    audioRingBuffer ring;
+    uint32_t sampleRate;
+    int16_t amplitude;
+
+    double phase;               // bit position in the pattern
+    double pendingSamples;      // fraction of a sample carried over to the next frame
+    std::vector<int16_t> frame;
+    std::vector<int16_t> transfer;
+    std::atomic<uint64_t> droppedSamples;   // ring buffer was full
+
+public:
+    explicit chip8Audio(uint32_t rate = AUDIO_DEFAULT_SAMPLE_RATE, size_t ringCapacity = AUDIO_RING_CAPACITY);
+
+    uint32_t getSampleRate() const { return sampleRate; }
+    void setVolume(float volume);
+
+    // producer side: one frame of samples; pattern is NULL for the buzzer
+    void renderFrame(bool active, const uint8_t* pattern, uint8_t pitch);
+
+    // consumer side: moves every queued sample to the sink; returns how many
+    size_t pump(audioSink& sink);
+
+    uint64_t getDroppedSamples() const { return droppedSamples.load(std::memory_order_relaxed); }
+};
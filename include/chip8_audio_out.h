@@ -0,0 +1,48 @@
+// Audio outputs of the frontends: a WAV file and the host's sound device. They live outside
+// libchip8, which only renders samples and hands them to whatever audioSink the host pumps into.
+
+#pragma once
+#include "chip8_audio.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+// 16-bit mono PCM WAV file; the RIFF sizes are filled in by close()
+class wavAudioSink : public audioSink
+{
+private:
+    FILE* file;
+    uint32_t dataBytes;
+
+public:
+    wavAudioSink() : file(NULL), dataBytes(0) { }
+    ~wavAudioSink() { close(); }
+
+    wavAudioSink(const wavAudioSink&) = delete;
+    wavAudioSink& operator=(const wavAudioSink&) = delete;
+
+    bool open(const char* fileName, uint32_t sampleRate);
+    void close();
+    void write(const int16_t* samples, size_t count);
+};
+
+// the platform's audio device: waveOut on Windows; elsewhere there is none and open() fails
+class hostAudioSink : public audioSink
+{
+private:
+    struct device;
+    device* impl;
+
+public:
+    hostAudioSink() : impl(NULL) { }
+    ~hostAudioSink() { close(); }
+
+    hostAudioSink(const hostAudioSink&) = delete;
+    hostAudioSink& operator=(const hostAudioSink&) = delete;
+
+    bool open(uint32_t sampleRate);
+    void close();
+
+    // never blocks: samples the device has no free buffer for are dropped
+    void write(const int16_t* samples, size_t count);
+};
@@ -0,0 +1,112 @@
+/* C interface of libchip8, for frontends in other languages and embedding. Everything goes
+ * through opaque handles: the library does no I/O, logs nothing, and keeps no global state,
+ * so handles on different threads are independent. A single handle is not thread-safe.
+ * Functions returning int return 1 on success and 0 on failure. */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+#ifdef CHIP8_BUILDING_SHARED
+#define CHIP8_API __declspec(dllexport)
+#elif defined(CHIP8_USING_SHARED)
+#define CHIP8_API __declspec(dllimport)
+#else
+#define CHIP8_API
+#endif
+#else
+#define CHIP8_API __attribute__((visibility("default")))
+#endif
+
+/* bumped whenever a declaration below changes incompatibly */
+#define CHIP8_ABI_VERSION 1
+
+/* values of the quirks arguments, in the order of quirkProfile */
+#define CHIP8_QUIRKS_COSMAC_VIP 0
+#define CHIP8_QUIRKS_CHIP48 1
+#define CHIP8_QUIRKS_SUPER_CHIP 2
+#define CHIP8_QUIRKS_XO_CHIP 3
+#define CHIP8_QUIRKS_MODERN 4
+
+#define CHIP8_DISPLAY_ROW_WORDS 2   /* 64-bit words per framebuffer row, leftmost pixel in the top bit */
+#define CHIP8_KEYS 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8_machine chip8_machine;
+typedef struct chip8_env chip8_env;
+
+CHIP8_API uint32_t chip8_abi_version(void);
+
+/* NULL for an unknown quirk profile or if out of memory */
+CHIP8_API chip8_machine* chip8_create(int quirks);
+CHIP8_API void chip8_destroy(chip8_machine* machine);
+
+/* loads a ROM image at 0x200 and resets the machine, CXNN seeded with CHIP8_DEFAULT_SEED (1) */
+CHIP8_API int chip8_load(chip8_machine* machine, const uint8_t* data, size_t size);
+CHIP8_API void chip8_seed_random(chip8_machine* machine, uint32_t seed);
+
+/* at most cycles instructions, a fused superinstruction counting as each instruction it covers;
+ * stops early while halted or waiting for a key (FX0A). Returns the instructions executed */
+CHIP8_API uint64_t chip8_run_cycles(chip8_machine* machine, uint32_t cycles);
+
+/* frames of cycles_per_frame instructions, each followed by a 60 Hz timer tick */
+CHIP8_API uint64_t chip8_run_frames(chip8_machine* machine, uint32_t frames, uint32_t cycles_per_frame);
+CHIP8_API void chip8_tick_timers(chip8_machine* machine);
+
+/* the current resolution: 64x32, or 128x64 in SUPER-CHIP high resolution */
+CHIP8_API int chip8_get_width(const chip8_machine* machine);
+CHIP8_API int chip8_get_height(const chip8_machine* machine);
+
+/* bit plane 0 or 1 as 64 rows of CHIP8_DISPLAY_ROW_WORDS words; valid for the handle's lifetime.
+ * Low resolution uses the top-left 64x32 pixels */
+CHIP8_API const uint64_t* chip8_get_framebuffer(const chip8_machine* machine, int plane);
+
+/* 1 if the display changed since the last call */
+CHIP8_API int chip8_take_draw_flag(chip8_machine* machine);
+
+CHIP8_API const uint8_t* chip8_get_memory(const chip8_machine* machine);
+
+CHIP8_API void chip8_set_key(chip8_machine* machine, int key, int pressed);
+
+/* bit k - key k held; only the keys that changed are passed on */
+CHIP8_API void chip8_set_keys(chip8_machine* machine, uint16_t mask);
+
+CHIP8_API int chip8_is_halted(const chip8_machine* machine);
+CHIP8_API int chip8_is_waiting_for_key(const chip8_machine* machine);
+CHIP8_API int chip8_is_sound_on(const chip8_machine* machine);
+
+/* snapshots: a buffer of chip8_state_size() bytes, any alignment. Only the memory the quirk
+ * profile addresses is saved, so loading returns 0 for a buffer saved by another build of the
+ * library or by a machine with another quirk profile. */
+CHIP8_API size_t chip8_state_size(void);
+CHIP8_API void chip8_save_state(const chip8_machine* machine, void* buffer);
+CHIP8_API int chip8_load_state(chip8_machine* machine, const void* buffer);
+
+/* vectorized environment for reinforcement learning, see chip8_env.h */
+#define CHIP8_OBSERVATION_PACKED 0
+#define CHIP8_OBSERVATION_UNPACKED 1
+#define CHIP8_REWARD_DELTA 0
+#define CHIP8_REWARD_VALUE 1
+
+CHIP8_API chip8_env* chip8_env_create(size_t count, int quirks, int observation_format, int high_resolution,
+    int cycles_per_frame, uint32_t max_episode_frames);
+CHIP8_API void chip8_env_destroy(chip8_env* env);
+CHIP8_API int chip8_env_load(chip8_env* env, const uint8_t* data, size_t size);
+
+/* bytes 1 to 4; bcd - one decimal digit per byte */
+CHIP8_API void chip8_env_add_reward_probe(chip8_env* env, uint16_t address, int bytes, int bcd, int kind, float scale);
+
+/* episodes also end when memory[address] == value */
+CHIP8_API void chip8_env_set_terminal_probe(chip8_env* env, uint16_t address, uint8_t value);
+
+CHIP8_API size_t chip8_env_observation_size(const chip8_env* env);
+CHIP8_API void chip8_env_reset(chip8_env* env, uint32_t seed, uint8_t* observations);
+CHIP8_API void chip8_env_step(chip8_env* env, const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* done);
+
+#ifdef __cplusplus
+}
+#endif
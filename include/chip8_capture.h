@@ -0,0 +1,91 @@
+// Video capture of the emulated display. submit() only copies the bit-packed planes into a
+// pooled slot; a worker thread upscales, converts and writes the frames, so recording never
+// waits for the disk. The output is always the 128x64 high resolution times the scale factor,
+// low resolution frames are doubled.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CAPTURE_POOL_FRAMES 16                  // frames in flight between submit() and the writer
+#define CAPTURE_MAX_SCALE 16
+#define CAPTURE_STREAM_BUFFER (1 << 20)         // stdio buffer of the stream formats
+
+enum captureFormat
+{
+    CAPTURE_RAW,    // headerless rgb24 frames (ffmpeg -f rawvideo -pix_fmt rgb24)
+    CAPTURE_Y4M,    // YUV4MPEG2 4:2:0 stream
+    CAPTURE_PPM     // one binary PPM per frame; the file name is a pattern such as frame%05u.ppm, with
+                    // exactly one %u or %0Nu for the frame index and %% for a literal percent sign
+};
+
+class chip8Capture
+{
+private:
+    struct frameSlot
+    {
+        uint64_t display[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT][DISPLAY_ROW_WORDS];
+        bool hires;
+    };
+
+    captureFormat format;
+    int scale;
+    int width;
+    int height;
+    FILE* stream;
+    char fileName[256];
+
+    // circular pool; slots [tail, tail + queued) belong to the writer, the rest to submit()
+    std::vector<frameSlot> slots;
+    size_t head;
+    size_t tail;
+    size_t queued;
+    bool stopping;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::thread worker;
+
+    // writer-side buffers, allocated once by open()
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> scaledRow;
+    std::vector<char> streamBuffer;
+
+    std::atomic<uint64_t> writtenFrames;
+    std::atomic<uint64_t> droppedFrames;
+    std::atomic<bool> failed;
+
+    void run();
+    void convert(const frameSlot& frame);
+    bool writeFrame(uint64_t index);
+
+public:
+    chip8Capture();
+    ~chip8Capture() { close(); }
+
+    chip8Capture(const chip8Capture&) = delete;
+    chip8Capture& operator=(const chip8Capture&) = delete;
+
+    // false for a bad scale, a PPM pattern that is not a single frame index conversion, or an
+    // output file that cannot be created
+    bool open(const char* path, captureFormat captureFormat, int scaleFactor);
+
+    // emulator side; never blocks: returns false and drops the frame when every slot is in flight
+    bool submit(const chip8& c8);
+
+    // writes the frames still queued and closes the output
+    void close();
+
+    bool isOpen() const { return worker.joinable(); }
+    bool hasFailed() const { return failed.load(std::memory_order_relaxed); }
+    uint64_t getWrittenFrames() const { return writtenFrames.load(std::memory_order_relaxed); }
+    uint64_t getDroppedFrames() const { return droppedFrames.load(std::memory_order_relaxed); }
+};
+
+// "raw", "y4m" or "ppm"
+bool parseCaptureFormat(const char* name, captureFormat& format);
@@ -0,0 +1,96 @@
+// Host time for the frontends. A frame is one 60 Hz period: a batch of instructions and a timer
+// tick. framePacer hands out the frames that are due against absolute deadlines, so sleeping late
+// never accumulates drift, and measures how late every wake-up was.
+
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+#define CLOCK_FRAME_PERIOD_NS 16666667ULL   // 60 Hz
+#define CLOCK_MAX_CATCH_UP 4                // frames run back to back after a stall; older ones are dropped
+#define CLOCK_SPIN_MARGIN_NS 500000         // last stretch before a deadline that is spun instead of slept
+#define CLOCK_UNCAPPED_FRAMES 16            // frames per waitForFrames() when the speed is uncapped
+
+class hostClock
+{
+public:
+    virtual ~hostClock() { }
+
+    // nanoseconds since an arbitrary origin
+    virtual uint64_t now() = 0;
+
+    // returns at (or after) the deadline
+    virtual void waitUntil(uint64_t deadline) = 0;
+};
+
+// Emulated time that jumps to every deadline at once: headless runs go as fast as the host can.
+class virtualClock : public hostClock
+{
+private:
+    uint64_t time;
+
+public:
+    virtualClock() : time(0) { }
+
+    uint64_t now() { return time; }
+    void waitUntil(uint64_t deadline) { if (deadline > time) time = deadline; }
+};
+
+// Wall-clock time. The OS sleep is known to overshoot, so it stops short of the deadline and the
+// remaining CLOCK_SPIN_MARGIN_NS are spun with yields.
+class realTimeClock : public hostClock
+{
+public:
+    uint64_t now();
+    void waitUntil(uint64_t deadline);
+};
+
+struct pacingStats
+{
+    uint64_t frames;            // handed out by waitForFrames
+    uint64_t droppedFrames;     // beyond the catch-up limit
+    double meanLateness;        // microseconds a wake-up came after its deadline
+    double jitter;              // standard deviation of the lateness, microseconds
+    double maxLateness;
+    double cpuUsage;            // process CPU time per wall time since the pacer started, 1.0 = one core
+};
+
+class framePacer
+{
+private:
+    hostClock* clock;
+    uint64_t period;
+    int maxCatchUp;
+    uint64_t nextDeadline;
+
+    // emulated frames per host frame period; 0 runs uncapped
+    double speed;
+    uint64_t step;              // host time between frame deadlines at this speed
+    int maxDue;
+
+    uint64_t frames;
+    uint64_t droppedFrames;
+    uint64_t wakeUps;
+    double latenessSum;         // microseconds
+    double latenessSquares;
+    double latenessMax;
+
+    uint64_t startWall;         // nanoseconds of the steady clock, whatever the host clock is
+    std::clock_t startCpu;
+
+public:
+    explicit framePacer(hostClock& hostTime, uint64_t framePeriod = CLOCK_FRAME_PERIOD_NS, int catchUpLimit = CLOCK_MAX_CATCH_UP);
+
+    // the next frame is due one period from now, e.g. after the emulation was paused
+    void restart();
+
+    // waits for the next deadline and returns how many frames are due, 1 .. catch-up limit
+    // (scaled by the speed); uncapped, it returns CLOCK_UNCAPPED_FRAMES without waiting
+    int waitForFrames();
+
+    // fast-forward: 2.0 runs twice as many frames per second, 0 as many as the host can
+    void setSpeed(double factor);
+    double getSpeed() const { return speed; }
+
+    pacingStats getStats() const;
+};
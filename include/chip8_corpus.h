@@ -0,0 +1,41 @@
+// ROM corpus of chip8-bench and of the profile-guided build: small programs, each with the quirk
+// profile, speed, length and recorded inputs of a representative session, so that every run of
+// a session executes exactly the same instructions. The programs are public domain.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstddef>
+
+#define CORPUS_ROMS_NUMBER 5
+#define CORPUS_SEED 1           // CXNN seed of every session
+
+// from frame on, the keys in the mask are held (bit k - key k), until the next entry
+struct corpusInput
+{
+    uint32_t frame;
+    uint16_t keys;
+};
+
+struct corpusRom
+{
+    const char* name;
+    const char* origin;
+    quirkProfile quirks;
+    const uint8_t* data;
+    size_t size;
+    int cyclesPerFrame;
+    uint32_t frames;            // length of a session
+
+    // sorted by frame; with inputPeriod > 0 they repeat every inputPeriod frames, all keys
+    // released at the start of each period
+    const corpusInput* inputs;
+    size_t inputsNumber;
+    uint32_t inputPeriod;
+};
+
+extern const corpusRom corpusRoms[CORPUS_ROMS_NUMBER];
+
+// loads the ROM into c8 and plays one session, through the micro-op IR if useIR; returns the
+// instructions executed, 0 if the ROM does not load
+uint64_t playCorpusRom(chip8& c8, const corpusRom& rom, bool useIR);
@@ -0,0 +1,105 @@
+// Vectorized environment for reinforcement learning: N instances of one ROM stepped together,
+// one emulated frame per step. An action is the 16-bit mask of the keys held during the frame.
+// Observations are written into a caller-provided buffer of N * getObservationSize() bytes, and
+// rewards are read from memory through probes. A finished instance is reset to a new episode
+// within the same step, and its observation is the first one of that episode.
+// Instances come from a chip8Pool, so a reset costs what the episode dirtied. After construction,
+// reset() and step() allocate nothing. An environment is not thread-safe: use one per worker thread.
+
+#pragma once
+#include "chip8.h"
+#include "chip8_pool.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+enum observationFormat
+{
+    OBSERVATION_PACKED,     // one bit per pixel lit in any plane, rows of bytes, leftmost pixel in the top bit
+    OBSERVATION_UNPACKED    // one byte per pixel, its plane color (bit p - lit in plane p)
+};
+
+enum rewardKind
+{
+    REWARD_DELTA,           // scale * (value - value before the step)
+    REWARD_VALUE            // scale * value
+};
+
+struct rewardProbe
+{
+    uint16_t address;
+    int bytes;              // 1 to 4, big-endian like the CHIP-8 itself
+    bool bcd;               // the bytes are decimal digits, one per byte, as stored by FX33
+    rewardKind kind;
+    float scale;
+};
+
+struct envConfig
+{
+    quirkProfile quirks;
+    observationFormat format;
+    bool highResolution;    // 128x64 observations with low-resolution frames doubled; else 64x32,
+                            // high-resolution frames sampled at every other pixel
+    int cyclesPerFrame;
+    uint32_t maxEpisodeFrames;  // 0 - no limit
+
+    // an episode also ends when memory[terminalAddress] == terminalValue, if terminalAddress >= 0
+    int terminalAddress;
+    uint8_t terminalValue;
+
+    chip8Logger* logger;    // diagnostics of the instances, NULL for none
+
+    envConfig() : quirks(QUIRKS_MODERN), format(OBSERVATION_PACKED), highResolution(false), cyclesPerFrame(16),
+        maxEpisodeFrames(0), terminalAddress(-1), terminalValue(0), logger(NULL) { }
+};
+
+class chip8VectorEnv
+{
+private:
+    envConfig config;
+    chip8Pool pool;
+    int romId;
+    std::vector<chip8*> instances;
+    std::vector<rewardProbe> probes;
+    std::vector<uint32_t> probeValues;      // instance i, probe p at i * probes.size() + p
+    std::vector<uint32_t> episodeFrames;
+    std::vector<uint32_t> episodes;         // per instance, for the seed of its next episode
+    uint32_t baseSeed;
+
+    uint32_t readProbe(const chip8& c8, const rewardProbe& probe) const;
+    void startEpisode(size_t index);
+    void writeObservation(const chip8& c8, uint8_t* observation) const;
+
+public:
+    chip8VectorEnv(size_t count, const envConfig& settings);
+    ~chip8VectorEnv();
+
+    chip8VectorEnv(const chip8VectorEnv&) = delete;
+    chip8VectorEnv& operator=(const chip8VectorEnv&) = delete;
+
+    bool loadROM(const uint8_t* data, size_t size);
+
+    // probes are summed into the reward of every step; add them before reset()
+    void addRewardProbe(const rewardProbe& probe) { probes.push_back(probe); }
+
+    // episodes also end when memory[address] == value; a negative address turns the check off
+    void setTerminalProbe(int address, uint8_t value)
+    {
+        config.terminalAddress = address;
+        config.terminalValue = value;
+    }
+
+    // starts a new episode on every instance; instance i of episode e is seeded from seed, i and e
+    void reset(uint32_t seed, uint8_t* observations = NULL);
+
+    // actions, rewards and done hold one entry per instance, observations getObservationSize() bytes
+    // per instance; rewards and done may be NULL
+    void step(const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* done);
+
+    size_t getCount() const { return instances.size(); }
+    int getObservationWidth() const { return config.highResolution ? DISPLAY_HIRES_WIDTH : DISPLAY_LORES_WIDTH; }
+    int getObservationHeight() const { return config.highResolution ? DISPLAY_HIRES_HEIGHT : DISPLAY_LORES_HEIGHT; }
+    size_t getObservationSize() const;
+
+    const chip8& getInstance(size_t index) const { return *instances[index]; }
+};
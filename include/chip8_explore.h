@@ -0,0 +1,104 @@
+// Breadth-first exploration of the input sequences of a ROM, for coverage testing. A node is a
+// machine state stopped in front of an input poll (EX9E, EXA1 or FX0A). Expanding it runs one
+// branch per key, plus one with no key for EX9E/EXA1, up to the next poll. Every resulting state
+// is hashed, and duplicates, also those reached by other threads, are dropped through
+// a concurrentHashSet. EX9E/EXA1 read a single key, so only two of their branches can
+// differ; the other fifteen are counted as duplicates without being run.
+//
+// Nodes are stored compactly: the registers and display, plus the memory pages that differ
+// from the start state. Each level is expanded by all worker threads, each with its own chip8.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+#define EXPLORE_DEFAULT_MAX_STATES (1 << 20)
+#define EXPLORE_DEFAULT_MAX_FRONTIER 65536
+#define EXPLORE_DEFAULT_SEGMENT_FRAMES 600  // frames run without a poll before a node is cut anyway
+#define EXPLORE_KEY_NONE KEYS_NUMBER        // branch in which no key is pressed
+
+// lock-free insert-only set of 64-bit hashes; open addressing with linear probing
+class concurrentHashSet
+{
+private:
+    std::vector<std::atomic<uint64_t>> slots;   // 0 - empty
+    size_t mask;
+    size_t limit;                               // inserts accepted before the set reports full
+    std::atomic<size_t> count;
+
+public:
+    // capacity is rounded up to a power of two; the set holds up to 3/4 of it
+    explicit concurrentHashSet(size_t capacity);
+
+    // true if the hash was not in the set yet; false for duplicates and once the set is full
+    bool insert(uint64_t hash);
+
+    // not thread-safe
+    void clear();
+
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+    bool isFull() const { return count.load(std::memory_order_relaxed) >= limit; }
+};
+
+struct exploreOptions
+{
+    int maxDepth;               // input polls along a path; 0 - until the frontier runs dry
+    size_t maxStates;           // distinct states kept in the hash set
+    size_t maxFrontier;         // nodes per level; the rest of a level is dropped and counted
+    int cyclesPerFrame;         // instructions between two tickTimers()
+    int segmentFrames;
+    unsigned threads;
+
+    exploreOptions() : maxDepth(0), maxStates(EXPLORE_DEFAULT_MAX_STATES), maxFrontier(EXPLORE_DEFAULT_MAX_FRONTIER),
+        cyclesPerFrame(16), segmentFrames(EXPLORE_DEFAULT_SEGMENT_FRAMES), threads(1) { }
+};
+
+struct exploreStats
+{
+    int levels;
+    uint64_t states;            // distinct states, the start state included
+    uint64_t duplicates;        // branches ending in a state seen before
+    uint64_t halted;            // branches that stopped the machine
+    uint64_t truncated;         // new states dropped by maxFrontier or a full hash set
+    uint64_t branchesRun;
+    uint64_t instructions;
+    uint64_t distinctFrames;    // distinct framebuffers among the states
+    uint32_t coveredAddresses;  // program bytes of the instructions executed
+    uint32_t litPixels;         // pixels lit in any state, in high-resolution coordinates
+    double seconds;
+};
+
+class stateExplorer
+{
+private:
+    struct worker;
+
+    exploreOptions options;
+    std::vector<chip8State> start;      // one element; the memory every node is stored against
+    quirkProfile quirks;
+    uint16_t memoryMask;                // of the explored machine's profile
+    concurrentHashSet states;
+    concurrentHashSet frames;
+    std::vector<uint64_t> coveredPcs;   // bit a - an instruction at address a was executed
+    uint64_t litPixels[DISPLAY_HIRES_HEIGHT][DISPLAY_ROW_WORDS];
+    std::atomic<size_t> nextLevelSize;  // nodes of the level being built, for maxFrontier
+    exploreStats stats;
+
+    static uint64_t hashNode(const chip8State& state, int cycle, const std::vector<uint16_t>& pages);
+    static uint64_t hashDisplay(const chip8State& state);
+
+    void expandNode(worker& w, const uint8_t* node);
+    void runBranch(worker& w, int branchKey, int cycle, const std::vector<uint16_t>& parentPages);
+
+public:
+    stateExplorer(const exploreOptions& exploreSettings);
+
+    // explores from the current state of the machine, which is left untouched
+    bool explore(const chip8& machine);
+
+    const exploreStats& getStats() const { return stats; }
+    bool isAddressCovered(uint16_t address) const { return (coveredPcs[address / 64] >> (address % 64)) & 1; }
+};
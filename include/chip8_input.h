@@ -0,0 +1,72 @@
+// Keyboard input of the frontends. keyMap translates host key codes through a 256-entry table,
+// optionally loaded from a file; inputQueue carries timestamped key transitions from the thread
+// that receives them to the emulation thread, which applies them between instructions. With
+// every transition going through the queue, a run is reproducible from its events.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <atomic>
+#include <vector>
+
+#define INPUT_QUEUE_CAPACITY 256    // power of two
+#define INPUT_MAX_HOLD_INSTRUCTIONS 1000    // longest a release waits for the program to read the keypad
+
+class keyMap
+{
+private:
+    int8_t keys[256];           // CHIP-8 key of every host key, -1 for none
+
+public:
+    keyMap() { setDefault(); }
+
+    // 1234 / qwer / asdf / zxcv, the layout of the COSMAC VIP keypad
+    void setDefault();
+
+    // lines of "<host key> <CHIP-8 key in hex>"; the host key is a character or a 0xNN code,
+    // '#' starts a comment. Replaces the whole table; false if the file cannot be read
+    bool load(const char* fileName);
+
+    int lookup(unsigned char hostKey) const { return keys[hostKey]; }
+};
+
+struct inputEvent
+{
+    uint64_t time;              // host nanoseconds when the transition was received
+    uint8_t key;
+    bool pressed;
+};
+
+// lock-free SPSC ring: push() on the input thread, apply() on the emulation thread
+class inputQueue
+{
+private:
+    std::vector<inputEvent> events;
+    size_t mask;
+    alignas(64) std::atomic<size_t> writePosition;
+    alignas(64) std::atomic<size_t> readPosition;
+    std::atomic<uint64_t> dropped;
+
+    // emulation thread only: per key, whether its last applied transition was a press, and the key
+    // reads and instructions the core had retired before it
+    bool pressPending[KEYS_NUMBER];
+    uint32_t pressKeyReads[KEYS_NUMBER];
+    uint64_t pressInstructions[KEYS_NUMBER];
+
+    bool isReleaseHeld(const chip8& c8, uint8_t key) const;
+
+public:
+    explicit inputQueue(size_t capacity = INPUT_QUEUE_CAPACITY);
+
+    // false (and counted) if the emulation thread fell behind by a whole queue
+    bool push(uint64_t time, uint8_t key, bool pressed);
+
+    bool isEmpty() const { return readPosition.load(std::memory_order_relaxed) == writePosition.load(std::memory_order_acquire); }
+
+    // hands the events received up to the given time to chip8::setKey, in order; returns how many.
+    // A release stays queued, with everything behind it, until the core has read the keypad since
+    // the press (see isReleaseHeld), so a tap shorter than one slice is still seen as a press.
+    size_t apply(chip8& c8, uint64_t upTo = UINT64_MAX);
+
+    uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,122 @@
+// Micro-op IR for the Chip 8 core
+// straight-line runs of opcodes (basic blocks) are decoded once into micro-ops, optimized
+// and then executed by a small interpreter loop; no native code is generated
+//
+// Experimental: no frontend runs it. chip8-bench (the ir variants), the corpus replay and chip8-irtest
+// are its only users. It beats the interpreter on a single instance, but loses with many instances
+// in a batch, where each one's block cache competes for the data cache.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <vector>
+
+#define IR_MAX_BLOCK_INSTRUCTIONS 32
+
+enum microOpKind : uint8_t
+{
+    UOP_NOP,
+    UOP_SET_IMM,        // VX = NN
+    UOP_ADD_IMM,        // VX += NN
+    UOP_MOV,            // VX = VY
+    UOP_OR,             // VX |= VY
+    UOP_AND,            // VX &= VY
+    UOP_XOR,            // VX ^= VY
+    UOP_ADD,            // VX += VY, VF = carry
+    UOP_ADD_NF,         // same without computing VF
+    UOP_SUB,            // VX -= VY, VF = no borrow
+    UOP_SUB_NF,
+    UOP_SUBN,           // VX = VY - VX, VF = no borrow
+    UOP_SUBN_NF,
+    UOP_SHR,            // VX = VY >> 1, VF = shifted out bit
+    UOP_SHR_NF,
+    UOP_SHL,            // VX = VY << 1, VF = shifted out bit
+    UOP_SHL_NF,
+    UOP_SET_I,          // I = NNN
+    UOP_ADD_I,          // I += VX, VF = overflow past 0xFFF
+    UOP_ADD_I_NF,
+    UOP_FONT_I,         // I = VX * 5
+    UOP_GET_DELAY,      // VX = delay timer
+    UOP_SET_DELAY,      // delay timer = VX
+    UOP_SET_SOUND,      // sound timer = VX
+    UOP_RAND,           // VX = random & NN
+    UOP_BCD,            // memory[I..I+2] = BCD of VX
+    UOP_STORE,          // memory[I..I+N] = V0..VN, I += imm
+    UOP_LOAD,           // V0..VN = memory[I..I+N], I += imm
+    UOP_DRAW,           // DXYN, clipped at the edges
+    UOP_DRAW_WRAP,      // DXYN, wrapping around the edges
+    UOP_CLS,            // 00E0
+
+    // block terminators; each one sets pc
+    UOP_CONTINUE,       // pc = NNN (falls through to the next block)
+    UOP_JUMP,           // pc = NNN
+    UOP_JUMP_OFFSET,    // pc = NNN + VY (V0, or VX for BXNN)
+    UOP_CALL,
+    UOP_RET,
+    UOP_SKIP_EQ_IMM,    // skips if VX == NN
+    UOP_SKIP_NE_IMM,    // skips if VX != NN
+    UOP_SKIP_NE_REG,    // skips if VX != VY (5XY0 as the interpreter runs it, and 9XY0)
+    UOP_SKIP_KEY,       // skips if key VX is pressed
+    UOP_SKIP_NKEY,      // skips if key VX is not pressed
+    UOP_FALLBACK        // runs the opcode through the regular interpreter
+};
+
+struct microOp
+{
+    uint8_t kind;
+    uint8_t dst;        // X register
+    uint8_t src;        // Y register
+    uint8_t n;          // sprite height or last register of FX55 / FX65
+    uint16_t imm;       // immediate value or target address
+    uint16_t pc;        // address of the opcode the micro-op was decoded from
+};
+
+struct irBlock
+{
+    uint16_t start;
+    uint16_t instructionCount;
+
+    // memory pages the block was decoded from
+    uint16_t firstPage;
+    uint16_t lastPage;
+    std::vector<microOp> ops;
+};
+
+class chip8IR
+{
+private:
+    // index into blocks for every start address, -1 if not translated yet; 32 bits, as XO-CHIP
+    // memory has room for more than 32767 blocks
+    std::vector<int32_t> blockAt;
+    std::vector<irBlock> blocks;
+    std::vector<int32_t> freeBlocks;
+
+    // the live blocks decoded from each memory page, so a store only visits the blocks it invalidates
+    std::vector<std::vector<int32_t>> pageBlocks;
+
+    // pages written since the last lookup; blocks decoded from them are dropped before the next run
+    uint64_t writtenPages[(MEMORY_PAGES + 63) / 64];
+    bool anyPageWritten;
+
+    int32_t translate(const chip8& c8, uint16_t start);
+    void dropBlock(int32_t index);
+    void flushWrittenPages();
+
+    static void propagateConstants(std::vector<microOp>& ops);
+    static void eliminateDeadCode(std::vector<microOp>& ops);
+
+public:
+    chip8IR();
+
+    int executeBlock(chip8& c8);
+
+    // records a store into a memory page; safe to call while a block is running
+    void invalidatePage(uint16_t page)
+    {
+        writtenPages[page / 64] |= 1ULL << (page % 64);
+        anyPageWritten = true;
+    }
+
+    // drops every translated block, at the cost of the blocks rather than of the address space
+    void clear();
+};
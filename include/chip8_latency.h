@@ -0,0 +1,69 @@
+// Input-to-photon latency of a frontend, in two parts: from the host key event to the end of the
+// first emulated frame whose display changed after the program read a key (EX9E, EXA1, FX0A), and
+// from that frame to the buffer swap that showed it. One key press is followed at a time; presses
+// during a measurement are not timed.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define LATENCY_BUCKET_NS 50000             // histogram resolution
+#define LATENCY_BUCKETS 10000               // up to 500 ms; slower samples go to the last bucket
+#define LATENCY_TIMEOUT_FRAMES 120          // a press with no visible reaction within 2 s is abandoned
+
+class latencyHistogram
+{
+private:
+    std::vector<uint32_t> buckets;
+    uint64_t samples;
+    uint64_t maximum;
+
+public:
+    latencyHistogram() : buckets(LATENCY_BUCKETS), samples(0), maximum(0) { }
+
+    void record(uint64_t nanoseconds);
+
+    // upper edge of the bucket holding the given fraction of the samples, in nanoseconds
+    uint64_t percentile(double fraction) const;
+
+    uint64_t getSamples() const { return samples; }
+    uint64_t getMaximum() const { return maximum; }
+};
+
+class inputLatencyTracker
+{
+private:
+    enum stage
+    {
+        STAGE_IDLE,
+        STAGE_WAITING_FOR_READ,
+        STAGE_WAITING_FOR_CHANGE,
+        STAGE_WAITING_FOR_PRESENT
+    };
+
+    stage current;
+    uint64_t pressTime;
+    uint64_t frameTime;
+    uint32_t keyReadsAtPress;
+    uint64_t displayHash;
+    int framesWaited;
+    uint64_t abandoned;
+
+    latencyHistogram inputToFrame;
+    latencyHistogram frameToPhoton;
+
+    static uint64_t hashDisplay(const chip8& c8);
+
+public:
+    inputLatencyTracker() : current(STAGE_IDLE), pressTime(0), frameTime(0), keyReadsAtPress(0), displayHash(0),
+        framesWaited(0), abandoned(0) { }
+
+    // timestamps are nanoseconds of one steady clock
+    void onKeyPressed(uint64_t now, const chip8& c8);
+    void onFrame(uint64_t now, const chip8& c8);   // after each emulated frame
+    void onPresented(uint64_t now);                 // after the buffer swap returned
+
+    void report(FILE* output) const;
+};
@@ -0,0 +1,140 @@
+// Diagnostics of the core (unknown opcodes, ROM loading) as structured records. Emulation threads
+// only push a fixed-size record into a bounded lock-free queue; a background thread drains it,
+// collapses repeats and hands the records to the sink. The core itself does no I/O: the host
+// creates the logger and sets the sink; the frontends' stderr logger is in chip8_logsink.h.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define LOG_TEXT_SIZE 48
+#define LOG_QUEUE_CAPACITY 1024         // power of two
+#define LOG_RATE_LIMIT_PER_SECOND 20    // records per source, event, pc and opcode; the excess is only counted
+#define LOG_RATE_BUCKETS 256            // power of two; keys that collide share a window
+#define LOG_IDLE_WAKEUP_MS 1000         // an idle logger thread still wakes this often to report the rate limiter's counts
+
+enum logLevel : uint8_t
+{
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR
+};
+
+enum logEvent : uint8_t
+{
+    LOG_UNKNOWN_OPCODE,     // pc, opcode
+    LOG_PROGRAM_EXIT,       // pc (SUPER-CHIP 00FD)
+    LOG_SOUND_STOPPED,      // pc
+    LOG_ROM_OPENED,         // value = size, text = file name
+    LOG_ROM_OPEN_FAILED,    // text = file name
+    LOG_ROM_READ_FAILED,    // text = file name
+    LOG_ROM_TOO_BIG,        // value = size
+    LOG_RATE_LIMITED,       // value = event whose records the rate limiter dropped; source, pc, opcode of them
+    LOG_EVENTS_NUMBER
+};
+
+struct logRecord
+{
+    uint64_t time;          // nanoseconds since the logger was created
+    const void* source;     // emitting chip8 instance, NULL for static functions
+    uint32_t value;
+    uint16_t pc;
+    uint16_t opcode;
+    uint8_t level;
+    uint8_t event;
+    char text[LOG_TEXT_SIZE];
+};
+
+// called on the logger thread; repeats > 1 when identical records were collapsed, and for
+// LOG_RATE_LIMITED the number of records dropped
+typedef void (*logSink)(const logRecord& record, uint32_t repeats, void* context);
+
+class chip8Logger
+{
+private:
+    struct slot
+    {
+        std::atomic<size_t> sequence;
+        logRecord record;
+    };
+
+    std::vector<slot> queue;
+    std::atomic<size_t> enqueuePosition;
+    size_t dequeuePosition;
+
+    std::atomic<int> minimumLevel;
+    std::atomic<uint64_t> dropped;      // queue was full
+
+    // producer-side rate limiting: a one-second window per (source, event, pc, opcode), in a small
+    // hash table. A colliding key takes the bucket over together with its window, and the count the
+    // previous key had suppressed moves to its event's total.
+    struct rateBucket
+    {
+        std::atomic<uint64_t> key;          // rateKey() of the owner, 0 while unused
+        std::atomic<const void*> source;    // the owner's fields, for the LOG_RATE_LIMITED summary
+        std::atomic<uint32_t> site;         // event << 16 | pc; opcode below
+        std::atomic<uint16_t> opcode;
+        std::atomic<uint64_t> windowStart;
+        std::atomic<uint32_t> windowCount;
+        std::atomic<uint32_t> suppressed;
+    };
+    std::vector<rateBucket> rateBuckets;
+    std::atomic<uint32_t> suppressed[LOG_EVENTS_NUMBER];
+    uint32_t ratePerSecond;
+
+    std::mutex sinkMutex;               // taken by the logger thread and setSink() only
+    logSink sink;
+    void* sinkContext;
+
+    std::chrono::steady_clock::time_point created;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> drainedPosition;
+    std::thread worker;
+
+    // the logger thread sleeps on wakeup while the queue is empty; producers only take wakeMutex
+    // when sleeping says it may be waiting
+    std::mutex wakeMutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> sleeping;
+    bool wakePending;
+
+    uint64_t now() const;
+    bool isQueueEmpty() const;
+    void wake();
+    bool dequeue(logRecord& record);
+    void drain();
+    void emit(const logRecord& record, uint32_t repeats);
+    void run();
+
+public:
+    explicit chip8Logger(uint32_t maxPerSecond = LOG_RATE_LIMIT_PER_SECOND);
+    ~chip8Logger();
+
+    chip8Logger(const chip8Logger&) = delete;
+    chip8Logger& operator=(const chip8Logger&) = delete;
+
+    void setLevel(logLevel level) { minimumLevel.store(level, std::memory_order_relaxed); }
+    bool isEnabled(logLevel level) const { return level >= minimumLevel.load(std::memory_order_relaxed); }
+
+    // NULL, the initial sink, discards the records
+    void setSink(logSink newSink, void* context);
+
+    // lock-free for the caller unless it has to wake the sleeping logger thread; never blocks on the sink
+    void log(logLevel level, logEvent event, const void* source, uint16_t pc, uint16_t opcode,
+        uint32_t value = 0, const char* text = NULL);
+
+    // blocks until every record logged so far reached the sink
+    void flush();
+
+    uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    static const char* getEventName(logEvent event);
+    static void formatRecord(const logRecord& record, uint32_t repeats, char* buffer, size_t size);
+};
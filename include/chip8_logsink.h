@@ -0,0 +1,11 @@
+// Logging of the frontends: one process-wide logger whose records are printed to stderr. libchip8
+// never creates it; a frontend passes it to the machines and readers it wants diagnostics from.
+
+#pragma once
+#include "chip8_log.h"
+
+// logSink that prints each record as one formatRecord line
+void writeLogToStderr(const logRecord& record, uint32_t repeats, void* context);
+
+// created with the stderr sink on first use
+chip8Logger& getDefaultLogger();
@@ -0,0 +1,132 @@
+// Two-player netplay for ROMs whose players share the keypad. Both peers run the same
+// deterministic frames (same ROM, quirks and CXNN seed); a frame's keys are the OR of both
+// players' 16-bit key masks. The remote mask is predicted as its last known value so the local
+// player never waits; when the real one arrives and differs, the session restores the snapshot
+// taken before that frame and re-simulates up to the present within the same host frame.
+// Peers exchange state checksums of fully confirmed frames to detect desyncs.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define NETPLAY_MAX_ROLLBACK 8          // frames the local side may run ahead of the remote inputs
+#define NETPLAY_INPUT_WINDOW 64         // frames of inputs kept; power of two, > max rollback
+#define NETPLAY_REDUNDANT_INPUTS 16     // unacknowledged local inputs repeated in every packet
+#define NETPLAY_CHECKSUM_INTERVAL 60    // frames between desync checks
+#define NETPLAY_MAX_PACKET 128
+
+// UDP socket to one peer, with optional synthetic one-way latency and packet loss on sends
+class udpChannel
+{
+private:
+    struct delayedPacket
+    {
+        uint64_t sendTime;
+        size_t size;
+        uint8_t data[NETPLAY_MAX_PACKET];
+    };
+
+    int socketHandle;
+    uint8_t remoteAddress[32];      // sockaddr_storage-sized copy of the peer's address
+    uint32_t remoteAddressSize;
+
+    uint64_t latency;               // nanoseconds
+    double lossRate;
+    uint32_t randomState;
+    std::vector<delayedPacket> delayed;
+    uint64_t sentPackets;
+    uint64_t lostPackets;
+
+    void flushDelayed(uint64_t now);
+
+public:
+    udpChannel();
+    ~udpChannel() { close(); }
+
+    udpChannel(const udpChannel&) = delete;
+    udpChannel& operator=(const udpChannel&) = delete;
+
+    bool open(uint16_t localPort, const char* remoteHost, uint16_t remotePort);
+    void close();
+
+    void setImpairment(uint32_t latencyMilliseconds, double lossFraction, uint32_t seed = 1);
+
+    void send(const uint8_t* data, size_t size);
+
+    // non-blocking; returns the packet size, 0 when nothing arrived
+    size_t receive(uint8_t* data, size_t capacity);
+
+    uint64_t getSentPackets() const { return sentPackets; }
+    uint64_t getLostPackets() const { return lostPackets; }
+};
+
+struct netplayStats
+{
+    uint64_t rollbacks;
+    uint64_t resimulatedFrames;
+    uint32_t maxRollbackDepth;
+    uint64_t stalledFrames;         // host frames spent waiting for the remote inputs
+    uint64_t checksumsCompared;
+    uint64_t desyncs;
+    uint32_t lastChecksumFrame;
+    uint64_t lastChecksum;
+};
+
+class rollbackSession
+{
+private:
+    chip8& c8;
+    udpChannel& channel;
+    int localPlayer;                // 0 or 1
+    int cyclesPerFrame;
+
+    uint32_t frame;                 // next frame to simulate
+    std::vector<chip8State> snapshots;  // snapshots[f % size] - state before frame f
+
+    // per frame f % NETPLAY_INPUT_WINDOW
+    uint16_t localInputs[NETPLAY_INPUT_WINDOW];
+    uint16_t remoteInputs[NETPLAY_INPUT_WINDOW];    // received, or the prediction used
+    int64_t remoteFrames[NETPLAY_INPUT_WINDOW];     // frame whose received input the slot holds, -1 for none
+
+    int32_t confirmedRemoteFrame;   // every remote input up to it was received; -1 for none
+    int32_t remoteAckFrame;         // the remote has every local input up to it
+    int64_t rollbackFrom;           // earliest mispredicted frame, -1 for none
+
+    // checksums of the snapshots of every NETPLAY_CHECKSUM_INTERVAL-th frame once it is final
+    uint32_t nextChecksumFrame;
+    uint32_t sentChecksumFrame;     // latest local checksum, repeated in every packet
+    uint64_t sentChecksum;
+    uint32_t remoteChecksumFrame;
+    uint64_t remoteChecksum;
+    uint64_t localChecksums[NETPLAY_INPUT_WINDOW];
+    uint32_t localChecksumFrames[NETPLAY_INPUT_WINDOW];
+
+    netplayStats stats;
+
+    void runFrame(uint32_t f);
+    uint16_t predictRemote() const;
+    void receivePackets();
+    void sendInputs();
+    void checkChecksums();
+    void rollBack();
+
+public:
+    rollbackSession(chip8& emulator, udpChannel& peer, int player, int cycles);
+
+    // runs the next frame with the local keys; false (nothing run) while the remote is more than
+    // NETPLAY_MAX_ROLLBACK frames behind
+    bool advanceFrame(uint16_t localKeys);
+
+    // exchanges packets without running a frame, e.g. while waiting for the peer at the end
+    void poll();
+
+    uint32_t getFrame() const { return frame; }
+    int32_t getConfirmedFrame() const { return confirmedRemoteFrame; }
+    bool isRemoteAcknowledged(uint32_t upTo) const { return remoteAckFrame >= (int32_t)upTo; }
+    const netplayStats& getStats() const { return stats; }
+
+    // memorySize - chip8::getMemorySize() of the machine the state was saved from
+    static uint64_t hashState(const chip8State& state, size_t memorySize);
+};
@@ -0,0 +1,46 @@
+// Pool of chip8 instances for workloads that reset the emulator at a high rate (fuzzing,
+// reinforcement learning). Every ROM is loaded once into a pristine memory image; resetting a
+// pooled instance copies back only the memory pages and display rows its last run changed.
+// A pool is not thread-safe: use one per worker thread.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+class chip8Pool
+{
+private:
+    struct romImage
+    {
+        std::vector<uint8_t> memory;        // memory right after loading the ROM
+        quirkProfile quirks;
+        std::vector<chip8*> freeInstances;
+    };
+
+    std::vector<romImage> roms;
+    std::unordered_map<const chip8*, int> romOf;    // every instance the pool owns
+    chip8Logger* logger;                            // of the instances, NULL for none
+
+public:
+    chip8Pool() : logger(NULL) { }
+    explicit chip8Pool(chip8Logger* instanceLogger) : logger(instanceLogger) { }
+    ~chip8Pool();
+
+    chip8Pool(const chip8Pool&) = delete;
+    chip8Pool& operator=(const chip8Pool&) = delete;
+
+    // loads the ROM once to build its pristine image; returns the ROM id or -1
+    int addRom(const uint8_t* data, size_t size, quirkProfile quirks = QUIRKS_MODERN);
+
+    // returns an instance of the ROM in its post-load state, with CXNN seeded from seed
+    chip8* acquire(int romId, uint32_t seed);
+
+    // puts an acquired instance back into its post-load state
+    void reset(chip8* instance, uint32_t seed);
+
+    // returns the instance to the pool; it is reset lazily on the next acquire()
+    void release(chip8* instance);
+};
@@ -0,0 +1,95 @@
+// CHIP-8 variants disagree on a handful of opcodes. Every variant is a policy class whose
+// constants are template arguments of the interpreter, so each profile runs its own specialized
+// executeCycle with the quirk checks compiled away.
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+enum quirkProfile
+{
+    QUIRKS_COSMAC_VIP,      // original COSMAC VIP interpreter
+    QUIRKS_CHIP48,          // CHIP-48 on the HP-48
+    QUIRKS_SUPER_CHIP,      // SUPER-CHIP 1.1
+    QUIRKS_XO_CHIP,         // XO-CHIP as defined by Octo
+    QUIRKS_MODERN,          // what most emulators and newer ROMs expect; the default
+    QUIRK_PROFILES_NUMBER
+};
+
+// what FX55 / FX65 do to I
+enum quirkIndexIncrement
+{
+    INDEX_UNCHANGED,
+    INDEX_PLUS_X,
+    INDEX_PLUS_X_PLUS_1
+};
+
+struct cosmacVipQuirks
+{
+    static const bool shiftUsesVY = true;           // 8XY6 / 8XYE shift VY into VX instead of shifting VX
+    static const int indexIncrement = INDEX_PLUS_X_PLUS_1;
+    static const bool jumpUsesVX = false;           // BXNN jumps to XNN + VX instead of BNNN to NNN + V0
+    static const bool logicResetsVF = true;         // 8XY1 / 8XY2 / 8XY3 clear VF
+    static const bool spritesWrap = false;          // DXYN wraps pixels past the edges instead of clipping them
+    static const uint16_t memoryMask = 0x0FFF;      // addresses wrap at 4 KB (64 KB on XO-CHIP)
+};
+
+struct chip48Quirks
+{
+    static const bool shiftUsesVY = false;
+    static const int indexIncrement = INDEX_PLUS_X;
+    static const bool jumpUsesVX = true;
+    static const bool logicResetsVF = false;
+    static const bool spritesWrap = false;
+    static const uint16_t memoryMask = 0x0FFF;
+};
+
+struct superChipQuirks
+{
+    static const bool shiftUsesVY = false;
+    static const int indexIncrement = INDEX_UNCHANGED;
+    static const bool jumpUsesVX = true;
+    static const bool logicResetsVF = false;
+    static const bool spritesWrap = false;
+    static const uint16_t memoryMask = 0x0FFF;
+};
+
+struct xoChipQuirks
+{
+    static const bool shiftUsesVY = true;
+    static const int indexIncrement = INDEX_PLUS_X_PLUS_1;
+    static const bool jumpUsesVX = false;
+    static const bool logicResetsVF = false;
+    static const bool spritesWrap = true;
+    static const uint16_t memoryMask = 0xFFFF;
+};
+
+struct modernQuirks
+{
+    static const bool shiftUsesVY = false;
+    static const int indexIncrement = INDEX_PLUS_X_PLUS_1;
+    static const bool jumpUsesVX = false;
+    static const bool logicResetsVF = false;
+    static const bool spritesWrap = false;
+    static const uint16_t memoryMask = 0x0FFF;
+};
+
+// the same constants at run time, for code that is not specialized per profile (the IR translator)
+struct quirkSettings
+{
+    bool shiftUsesVY;
+    int indexIncrement;
+    bool jumpUsesVX;
+    bool logicResetsVF;
+    bool spritesWrap;
+    uint16_t memoryMask;
+};
+
+quirkSettings getQuirkSettings(quirkProfile profile);
+const char* getQuirkProfileName(quirkProfile profile);
+
+// accepts "vip", "chip48", "schip", "xochip" and "modern"
+bool parseQuirkProfile(const char* name, quirkProfile& profile);
+
+// 64-bit FNV-1a of the ROM image; the key of the ROM database (lookupQuirkProfile in chip8_rom.h)
+uint64_t hashRom(const uint8_t* data, size_t size);
@@ -0,0 +1,15 @@
+// ROM files and the ROM database for the frontends. libchip8 itself only takes ROM images and
+// quirk profiles from memory (chip8::loadROM, setQuirkProfile), so that embedding it never opens files.
+
+#pragma once
+#include "chip8_log.h"
+#include "chip8_quirks.h"
+#include <cstdint>
+#include <vector>
+
+// reads the whole file into rom; failures and the size read go to the logger, if any
+bool readRomFile(const char* fileName, std::vector<uint8_t>& rom, chip8Logger* logger);
+
+// ROM database: a text file with one "<16 hex digit hashRom value> <profile name>" per line;
+// '#' starts a comment. Returns false if the ROM is not listed or the file cannot be read.
+bool lookupQuirkProfile(const char* databaseFileName, const uint8_t* data, size_t size, quirkProfile& profile);
@@ -0,0 +1,86 @@
+// Framebuffer export through POSIX shared memory. The emulator publishes the display, the
+// registers and the frame counter under a seqlock; readers in other processes map the segment
+// read-only and copy a consistent snapshot without any call into the emulator, so they add no
+// load to its thread. Consumers only need this header (and -lrt on older glibc).
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+#define SHARED_FRAME_MAGIC 0x38504843   // "CHP8"
+#define SHARED_FRAME_VERSION 1
+
+// what a reader gets; plain data, copied as one block
+struct sharedFrameData
+{
+    uint64_t frame;                 // 60 Hz frames emulated so far
+    uint64_t executedInstructions;
+    uint16_t pc;
+    uint16_t I;
+    uint8_t V[REGS_NUMBER];
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t width;                  // 64x32 or 128x64
+    uint8_t height;
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HIRES_HEIGHT][DISPLAY_ROW_WORDS];   // as chip8::getDisplayRow
+};
+
+// layout of the segment
+struct sharedFrame
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // odd while the emulator is writing data
+    alignas(64) std::atomic<uint32_t> sequence;
+    sharedFrameData data;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the seqlock must work across processes");
+
+// reader side: copies the latest frame; false if the writer kept changing it during every attempt
+inline bool readSharedFrame(const sharedFrame* segment, sharedFrameData& snapshot, int attempts = 1000)
+{
+    for (int i = 0; i < attempts; i++)
+    {
+        uint32_t before = segment->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+        memcpy(&snapshot, (const void*)&segment->data, sizeof(snapshot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
+
+// writer (the emulator) and reader ends of a named segment, e.g. "/chip8-0"
+class chip8SharedFrame
+{
+private:
+    sharedFrame* segment;
+    char name[64];
+    bool owner;
+
+public:
+    chip8SharedFrame() : segment(NULL), owner(false) { name[0] = '\0'; }
+    ~chip8SharedFrame() { close(); }
+
+    chip8SharedFrame(const chip8SharedFrame&) = delete;
+    chip8SharedFrame& operator=(const chip8SharedFrame&) = delete;
+
+    // emulator side: creates (or takes over) the segment; it is unlinked again by close()
+    bool create(const char* segmentName);
+
+    // consumer side: maps an existing segment read-only
+    bool open(const char* segmentName);
+
+    void close();
+
+    // emulator side: a few kilobytes of stores, never waits for readers
+    void publish(const chip8& c8, uint64_t frame);
+
+    bool read(sharedFrameData& snapshot) const { return segment != NULL && readSharedFrame(segment, snapshot); }
+};
@@ -0,0 +1,47 @@
+// Terminal rendering of the display for SSH sessions and multiplexers. Pixels are packed into
+// Unicode half blocks (1x2 pixels per cell) or braille patterns (2x4); every frame only the cells
+// that changed since the previous one are emitted, as a single buffer the caller writes at once.
+// A pixel is lit when any plane is set.
+
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum terminalCellMode
+{
+    TERMINAL_HALF_BLOCKS,
+    TERMINAL_BRAILLE
+};
+
+class terminalRenderer
+{
+private:
+    terminalCellMode mode;
+    int originRow;      // 1-based terminal position of the top-left cell
+    int originColumn;
+
+    // what the terminal shows now; rebuilt from scratch after invalidate() or a resolution change
+    int width;
+    int height;
+    bool valid;
+    uint64_t shownRows[DISPLAY_HIRES_HEIGHT][DISPLAY_ROW_WORDS];
+    std::vector<uint8_t> cells;
+
+    std::string output;
+
+    void appendCell(uint8_t code);
+
+public:
+    explicit terminalRenderer(terminalCellMode cellMode, int row = 1, int column = 1);
+
+    // escape sequences that bring the terminal up to date with the display; empty if nothing changed
+    const std::string& render(const chip8& c8);
+
+    // forces a full redraw on the next render(), e.g. after the terminal was cleared
+    void invalidate() { valid = false; }
+
+    int getColumns() const;
+    int getRows() const;
+};
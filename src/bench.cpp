@@ -0,0 +1,809 @@
+// chip8-bench: deterministic measurements of the core without a window
+//
+// Microbenchmarks (micro/) time one hot path each on a fixed program: dispatch per opcode class,
+// DXYN, 00E0, FX33/FX55/FX65, timer ticks, framebuffer conversion and snapshots. Macrobenchmarks
+// (macro/) play the sessions of the ROM corpus (chip8_corpus.h) end to end; the same sessions are
+// the training run of the profile-guided build. Every benchmark runs a fixed amount of work, so
+// only the times change between runs. --json writes the results for tracking, and --baseline
+// compares ns/op with an earlier --json file, printing every change, and fails on regressions past
+// --tolerance percent.
+
+#include "chip8.h"
+#include "chip8_pool.h"
+#include "chip8_env.h"
+#include "chip8_corpus.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_REPEATS 3                   // microbenchmarks report the fastest of their runs
+#define BENCH_DEFAULT_TOLERANCE 10.0        // percent of ns/op
+#define BENCH_MACRO_INSTRUCTIONS 4000000    // per corpus ROM: whole sessions until at least this many
+#define BENCH_TEXTURE_WIDTH 128             // the frontend texture, see updateTexture in main.cpp
+#define BENCH_TEXTURE_HEIGHT 64
+
+typedef std::chrono::steady_clock benchClock;
+
+struct benchResult
+{
+    std::string name;
+    double nsPerOp;
+    double opsPerSecond;
+    double instructionsPerSecond;   // 0 - the operations are not instructions or frames of a program
+    double l1dMisses;               // per 1k instructions, < 0 - not measured
+    double llcMisses;
+};
+
+static std::vector<benchResult> results;
+static const char* nameFilter = NULL;
+static bool jsonOutput = false;
+static int workDivisor = 1;         // --quick runs a tenth of the work
+
+static bool isSelected(const char* name)
+{
+    return nameFilter == NULL || strncmp(name, nameFilter, strlen(nameFilter)) == 0;
+}
+
+static int scaled(int amount)
+{
+    return amount / workDivisor > 0 ? amount / workDivisor : 1;
+}
+
+// Hardware cache-miss counter of the calling thread (Linux perf events). Where the counters are
+// not available it reports itself as such and the benchmarks print n/a.
+class cacheMissCounter
+{
+private:
+    int fd;
+
+public:
+    cacheMissCounter(uint32_t type, uint64_t config) : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~cacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool isAvailable() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+};
+
+// Synthetic workload: fills the screen with sprites, then updates a BCD score and stores
+// registers at a random offset, so every frame dirties a few memory pages and all display rows.
+static const uint16_t workloadProgram[] =
+{
+    0x6300,     // 200: V3 = 0
+    0x00E0,     // 202: clear screen
+    0x6000,     // 204: V0 = 0
+    0x6100,     // 206: V1 = 0
+    0xA22E,     // 208: I = sprite
+    0xD015,     // 20A: draw at (V0, V1)
+    0x7008,     // 20C: V0 += 8
+    0x3040,     // 20E: skip if V0 == 64
+    0x1208,     // 210: next column
+    0x6000,     // 212: V0 = 0
+    0x7106,     // 214: V1 += 6
+    0x311E,     // 216: skip if V1 == 30
+    0x1208,     // 218: next row
+    0x7301,     // 21A: V3 += 1
+    0xA400,     // 21C: I = 0x400
+    0xF333,     // 21E: BCD of V3
+    0x8430,     // 220: V4 = V3
+    0x8444,     // 222: V4 += V4
+    0x8446,     // 224: V4 >>= 1
+    0xC50F,     // 226: V5 = random & 0x0F
+    0xF51E,     // 228: I += V5
+    0xF455,     // 22A: store V0..V4
+    0x1202,     // 22C: next frame
+    0xF090,     // 22E: sprite
+    0xF090,
+    0xF000
+};
+
+static std::vector<uint8_t> buildRom(const uint16_t* program, size_t count)
+{
+    std::vector<uint8_t> rom;
+    for (size_t i = 0; i < count; i++)
+    {
+        rom.push_back(program[i] >> 8);
+        rom.push_back(program[i] & 0xFF);
+    }
+    return rom;
+}
+
+static void report(const char* name, double seconds, uint64_t operations, uint64_t instructions = 0,
+    double l1dMisses = -1, double llcMisses = -1)
+{
+    benchResult result;
+    result.name = name;
+    result.nsPerOp = seconds * 1e9 / operations;
+    result.opsPerSecond = operations / seconds;
+    result.instructionsPerSecond = instructions / seconds;
+    result.l1dMisses = l1dMisses;
+    result.llcMisses = llcMisses;
+    results.push_back(result);
+    if (jsonOutput)
+        return;
+
+    printf("%-32s %10.2f ns/op %14.0f ops/sec", name, result.nsPerOp, result.opsPerSecond);
+    if (instructions > 0)
+        printf(" %9.1f M instr/sec", result.instructionsPerSecond / 1e6);
+    if (l1dMisses >= 0)
+        printf("  l1d %.2f", l1dMisses);
+    if (llcMisses >= 0)
+        printf("  llc %.2f misses/1k instr", llcMisses);
+    printf("\n");
+}
+
+// the fastest of BENCH_REPEATS runs of body, the one least disturbed by the rest of the system
+template <class Body> static double bestSeconds(Body body)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_REPEATS; run++)
+    {
+        benchClock::time_point start = benchClock::now();
+        body();
+        double seconds = std::chrono::duration<double>(benchClock::now() - start).count();
+        if (run == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+// runs the instructions of c8 up to target, stopping early if it halts or waits for a key
+static void runUntil(chip8& c8, uint64_t target, bool useIR)
+{
+    if (useIR)
+        while (c8.getExecutedInstructions() < target && !c8.isHalted() && !c8.isWaitingForKey())
+            c8.executeBlock();
+    else if (target > c8.getExecutedInstructions())
+        c8.executeInstructions(target - c8.getExecutedInstructions());
+}
+
+// setup once, then a loop of head and count copies of body
+static std::vector<uint16_t> loopProgram(const std::vector<uint16_t>& setup, const std::vector<uint16_t>& head,
+    const std::vector<uint16_t>& body, int count)
+{
+    std::vector<uint16_t> program(setup);
+    uint16_t loopAddress = (uint16_t)(0x200 + 2 * setup.size());
+    program.insert(program.end(), head.begin(), head.end());
+    for (int i = 0; i < count; i++)
+        program.insert(program.end(), body.begin(), body.end());
+    program.push_back(0x1000 | loopAddress);
+    return program;
+}
+
+// one hot path in isolation: a program looping over it; ops are instructions, the loop included
+static void benchProgram(const char* name, const std::vector<uint16_t>& program, quirkProfile quirks,
+    uint64_t instructions, bool useIR)
+{
+    if (!isSelected(name))
+        return;
+
+    std::vector<uint8_t> rom = buildRom(program.data(), program.size());
+    chip8 c8(NULL);
+    c8.setQuirkProfile(quirks);
+    c8.loadROM(rom.data(), rom.size());
+    c8.seedRandom(1);
+
+    uint64_t executed = 0;
+    double seconds = bestSeconds([&]()
+    {
+        uint64_t start = c8.getExecutedInstructions();
+        runUntil(c8, start + instructions, useIR);
+        executed = c8.getExecutedInstructions() - start;
+    });
+    report(name, seconds, executed, executed);
+}
+
+// dispatch cost per opcode class, on straight-line runs of one opcode and on a mix of them
+static void benchDispatch(bool useIR)
+{
+    struct opcodeClass
+    {
+        const char* name;
+        std::vector<uint16_t> setup;
+        std::vector<uint16_t> head;
+        std::vector<uint16_t> body;
+        int count;
+    };
+    std::vector<uint16_t> jumps;
+    for (int i = 1; i < 64; i++)
+        jumps.push_back((uint16_t)(0x1200 + 2 * i));
+
+    // the IR deletes a register write that is overwritten before its block ends, which would leave
+    // nothing of a run of 6XNN or FX07 to time; these write V0 to VE once each instead, so every write
+    // is still live at the loop jump that ends the block
+    std::vector<uint16_t> setEach, delayEach;
+    for (int x = 0; x < 0xF; x++)
+    {
+        setEach.push_back((uint16_t)(0x6005 | x << 8));
+        delayEach.push_back((uint16_t)(0xF007 | x << 8));
+    }
+    const opcodeClass classes[] =
+    {
+        { "6xnn", { }, { }, setEach, 1 },
+        { "7xnn", { }, { }, { 0x7A01 }, 64 },
+        { "8xy4", { 0x6B03 }, { }, { 0x8AB4 }, 64 },
+        { "8xy3", { 0x6B03 }, { }, { 0x8AB3 }, 64 },
+        { "8xy6", { 0x6BF0 }, { }, { 0x8AB6 }, 64 },
+        { "3xnn", { 0x6A00 }, { }, { 0x3AFF }, 64 },
+        { "annn", { }, { }, { 0xA300 }, 64 },
+        { "fx1e", { 0x6A01 }, { 0xA000 }, { 0xFA1E }, 64 },
+        { "cxnn", { }, { }, { 0xCAFF }, 64 },
+        { "fx07", { }, { }, delayEach, 1 },
+        { "2nnn", { }, { 0x2204 }, { }, 0 },     // call into the 00EE below the jump back
+        { "1nnn", { }, jumps, { }, 0 },
+        { "mix", { 0x6B03, 0x6C01 }, { }, { 0x6A05, 0x7B03, 0x8AB4, 0x3C01, 0x8BA3, 0xA300,
+            0x8AB6, 0xFB1E, 0x8CA5, 0xCD0F, 0xFE07, 0x8DB2 }, 8 }
+    };
+
+    for (const opcodeClass& opcodes : classes)
+    {
+        std::vector<uint16_t> program = loopProgram(opcodes.setup, opcodes.head, opcodes.body, opcodes.count);
+        if (strcmp(opcodes.name, "2nnn") == 0)
+            program.push_back(0x00EE);
+        char name[64];
+        snprintf(name, sizeof(name), "micro/dispatch/%s/%s", opcodes.name, useIR ? "ir" : "interp");
+        benchProgram(name, program, QUIRKS_MODERN, (uint64_t)scaled(10000000), useIR);
+    }
+}
+
+// DXYN at byte-aligned, unaligned and edge-crossing x, and SUPER-CHIP 16x16 DXY0
+static void benchDraw()
+{
+    const int heights[] = { 1, 5, 15 };
+    const int columns[] = { 0, 3, 60 };
+    char name[64];
+    for (int height : heights)
+        for (int x : columns)
+        {
+            snprintf(name, sizeof(name), "micro/dxyn/h%d/x%d", height, x);
+            benchProgram(name, loopProgram({ (uint16_t)(0x6A00 | x), 0x6B08, 0xA000 }, { },
+                { (uint16_t)(0xDAB0 | height) }, 32), QUIRKS_MODERN, (uint64_t)scaled(2000000), false);
+        }
+
+    const int hiresColumns[] = { 0, 3, 120 };
+    for (int x : hiresColumns)
+    {
+        snprintf(name, sizeof(name), "micro/dxy0/x%d", x);
+        benchProgram(name, loopProgram({ 0x00FF, (uint16_t)(0x6A00 | x), 0x6B08, 0xA000 }, { }, { 0xDAB0 }, 32),
+            QUIRKS_SUPER_CHIP, (uint64_t)scaled(2000000), false);
+    }
+}
+
+// 00E0 and the memory opcodes; FX55/FX65 advance I (modern quirks), so each loop starts at 0x400 again
+static void benchMemoryOpcodes()
+{
+    benchProgram("micro/00e0", loopProgram({ }, { }, { 0x00E0 }, 64), QUIRKS_MODERN, (uint64_t)scaled(2000000), false);
+    benchProgram("micro/fx33", loopProgram({ 0x6A7B }, { 0xA400 }, { 0xFA33 }, 64),
+        QUIRKS_MODERN, (uint64_t)scaled(5000000), false);
+    benchProgram("micro/fx55/v0-v3", loopProgram({ }, { 0xA400 }, { 0xF355 }, 32),
+        QUIRKS_MODERN, (uint64_t)scaled(5000000), false);
+    benchProgram("micro/fx55/v0-vf", loopProgram({ }, { 0xA400 }, { 0xFF55 }, 32),
+        QUIRKS_MODERN, (uint64_t)scaled(5000000), false);
+    benchProgram("micro/fx65/v0-v3", loopProgram({ }, { 0xA400 }, { 0xF365 }, 32),
+        QUIRKS_MODERN, (uint64_t)scaled(5000000), false);
+    benchProgram("micro/fx65/v0-vf", loopProgram({ }, { 0xA400 }, { 0xFF65 }, 32),
+        QUIRKS_MODERN, (uint64_t)scaled(5000000), false);
+}
+
+// tickTimers with both timers running, reloaded every 250 ticks, and with both stopped
+static void benchTimers()
+{
+    static const uint16_t reload[] = { 0x6AFF, 0xFA15, 0xFA18, 0x1200 };
+    std::vector<uint8_t> rom = buildRom(reload, sizeof(reload) / sizeof(reload[0]));
+    int ticks = scaled(20000000);
+
+    if (isSelected("micro/timers/running"))
+    {
+        chip8 c8(NULL);
+        c8.loadROM(rom.data(), rom.size());
+        double seconds = bestSeconds([&]()
+        {
+            for (int tick = 0; tick < ticks; tick += 250)
+            {
+                for (int i = 0; i < 4; i++)
+                    c8.executeCycle();
+                for (int i = 0; i < 250; i++)
+                    c8.tickTimers();
+            }
+        });
+        report("micro/timers/running", seconds, ticks);
+    }
+
+    if (isSelected("micro/timers/stopped"))
+    {
+        chip8 c8(NULL);
+        c8.loadROM(rom.data(), rom.size());
+        double seconds = bestSeconds([&]()
+        {
+            for (int tick = 0; tick < ticks; tick++)
+                c8.tickTimers();
+        });
+        report("micro/timers/stopped", seconds, ticks);
+    }
+}
+
+static const uint8_t benchPalette[4] = { 0, 255, 170, 85 };
+static uint8_t benchTexture[BENCH_TEXTURE_HEIGHT][BENCH_TEXTURE_WIDTH][3];
+
+// the frontend's conversion: one getPixel per texel
+static void convertPixels(const chip8& c8)
+{
+    int scale = BENCH_TEXTURE_WIDTH / c8.getDisplayWidth();
+    for (int y = 0; y < BENCH_TEXTURE_HEIGHT; y++)
+        for (int x = 0; x < BENCH_TEXTURE_WIDTH; x++)
+            benchTexture[y][x][0] = benchTexture[y][x][1] = benchTexture[y][x][2] = benchPalette[c8.getPixel(x / scale, y / scale)];
+}
+
+// the same from the bit-packed rows: each display row converted once, then copied to the other
+// texel rows it covers
+static void convertRows(const chip8& c8)
+{
+    int width = c8.getDisplayWidth();
+    int scale = BENCH_TEXTURE_WIDTH / width;
+    for (int y = 0; y < c8.getDisplayHeight(); y++)
+    {
+        uint8_t* texel = benchTexture[y * scale][0];
+        for (int word = 0; word < width / 64; word++)
+        {
+            uint64_t plane0 = c8.getDisplayRow(0, y)[word];
+            uint64_t plane1 = c8.getDisplayRow(1, y)[word];
+            for (int bit = 63; bit >= 0; bit--)
+            {
+                uint8_t value = benchPalette[((plane0 >> bit) & 1) | (((plane1 >> bit) & 1) << 1)];
+                for (int copy = 0; copy < 3 * scale; copy++)
+                    *texel++ = value;
+            }
+        }
+        for (int copy = 1; copy < scale; copy++)
+            memcpy(benchTexture[y * scale + copy], benchTexture[y * scale], sizeof(benchTexture[0]));
+    }
+}
+
+// display to texture, on the final frames of the maze (low resolution) and scroll (high) sessions
+static void benchFramebuffer()
+{
+    const char* sessions[] = { "maze", "scroll" };
+    int frames = scaled(20000);
+    for (const char* session : sessions)
+    {
+        const corpusRom* rom = NULL;
+        for (const corpusRom& candidate : corpusRoms)
+            if (strcmp(candidate.name, session) == 0)
+                rom = &candidate;
+        chip8 c8(NULL);
+        playCorpusRom(c8, *rom, false);
+        const char* resolution = c8.getDisplayWidth() == DISPLAY_HIRES_WIDTH ? "hires" : "lores";
+
+        char name[64];
+        uint32_t checksum = 0;
+        snprintf(name, sizeof(name), "micro/framebuffer/pixels/%s", resolution);
+        if (isSelected(name))
+        {
+            double seconds = bestSeconds([&]()
+            {
+                for (int frame = 0; frame < frames; frame++)
+                {
+                    convertPixels(c8);
+                    checksum += benchTexture[frame % BENCH_TEXTURE_HEIGHT][frame % BENCH_TEXTURE_WIDTH][0];
+                }
+            });
+            report(name, seconds, frames);
+        }
+
+        snprintf(name, sizeof(name), "micro/framebuffer/rows/%s", resolution);
+        if (isSelected(name))
+        {
+            double seconds = bestSeconds([&]()
+            {
+                for (int frame = 0; frame < frames; frame++)
+                {
+                    convertRows(c8);
+                    checksum += benchTexture[frame % BENCH_TEXTURE_HEIGHT][frame % BENCH_TEXTURE_WIDTH][0];
+                }
+            });
+            report(name, seconds, frames);
+        }
+
+        // keeps the conversions from being optimized away
+        if (checksum == 1)
+            printf(" ");
+    }
+}
+
+// saveState and loadState of a whole machine, and rewindState after one frame of the bounce session
+static void benchSnapshots()
+{
+    const corpusRom& rom = corpusRoms[1];
+    chip8 c8(NULL);
+    playCorpusRom(c8, rom, false);
+    std::vector<chip8State> snapshot(1);
+    c8.saveState(snapshot[0]);
+    int snapshots = scaled(100000);
+
+    if (isSelected("micro/snapshot/save"))
+    {
+        std::vector<chip8State> copy(1);
+        double seconds = bestSeconds([&]()
+        {
+            for (int i = 0; i < snapshots; i++)
+            {
+                copy[0].V[0] = (uint8_t)i;
+                c8.saveState(copy[0]);
+            }
+        });
+        report("micro/snapshot/save", seconds, snapshots);
+    }
+
+    if (isSelected("micro/snapshot/load"))
+    {
+        double seconds = bestSeconds([&]()
+        {
+            for (int i = 0; i < snapshots; i++)
+                c8.loadState(snapshot[0]);
+        });
+        report("micro/snapshot/load", seconds, snapshots);
+    }
+
+    if (isSelected("micro/snapshot/rewind"))
+    {
+        c8.loadState(snapshot[0]);
+        c8.clearDirtyPages();
+        double best = 0;
+        for (int run = 0; run < BENCH_REPEATS; run++)
+        {
+            double seconds = 0;
+            for (int i = 0; i < snapshots; i++)
+            {
+                runUntil(c8, c8.getExecutedInstructions() + rom.cyclesPerFrame, false);
+                c8.tickTimers();
+
+                benchClock::time_point start = benchClock::now();
+                c8.rewindState(snapshot[0]);
+                seconds += std::chrono::duration<double>(benchClock::now() - start).count();
+            }
+            if (run == 0 || seconds < best)
+                best = seconds;
+        }
+        report("micro/snapshot/rewind", best, snapshots);
+    }
+}
+
+// end to end: whole sessions of every corpus ROM with their recorded inputs; ops are frames
+static void benchCorpus(bool useIR)
+{
+    for (const corpusRom& rom : corpusRoms)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "macro/%s/%s", rom.name, useIR ? "ir" : "interp");
+        if (!isSelected(name))
+            continue;
+
+        chip8 c8(NULL);
+        uint64_t budget = scaled(BENCH_MACRO_INSTRUCTIONS);
+        uint64_t instructions = 0;
+        uint64_t frames = 0;
+        double seconds = bestSeconds([&]()
+        {
+            instructions = 0;
+            frames = 0;
+            while (instructions < budget)
+            {
+                uint64_t executed = playCorpusRom(c8, rom, useIR);
+                if (executed == 0)
+                    break;
+                instructions += executed;
+                frames += rom.frames;
+            }
+        });
+        report(name, seconds, frames, instructions);
+    }
+}
+
+// writes the results as JSON; --baseline reads the name and ns_per_op back from each line
+static void writeJson(FILE* file)
+{
+    fprintf(file, "{\n  \"repeats\": %d,\n  \"quick\": %s,\n  \"benchmarks\": [\n", BENCH_REPEATS,
+        workDivisor > 1 ? "true" : "false");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const benchResult& result = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f, \"instructions_per_sec\": ",
+            result.name.c_str(), result.nsPerOp, result.opsPerSecond);
+        if (result.instructionsPerSecond > 0)
+            fprintf(file, "%.1f", result.instructionsPerSecond);
+        else
+            fprintf(file, "null");
+        if (result.l1dMisses >= 0)
+            fprintf(file, ", \"l1d_misses_per_kinstr\": %.3f", result.l1dMisses);
+        if (result.llcMisses >= 0)
+            fprintf(file, ", \"llc_misses_per_kinstr\": %.3f", result.llcMisses);
+        fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+// compares ns/op with a file written by --json and prints the change of every benchmark in both,
+// and their geometric mean; returns the number of regressions past tolerance percent, or -1 if the
+// file cannot be read
+static int compareBaseline(const char* fileName, double tolerance)
+{
+    FILE* file = fopen(fileName, "r");
+    if (file == NULL)
+        return -1;
+
+    int regressions = 0;
+    int compared = 0;
+    double logRatios = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[128];
+        double baselineNs;
+        if (sscanf(line, " {\"name\": \"%127[^\"]\", \"ns_per_op\": %lf", name, &baselineNs) != 2 || baselineNs <= 0)
+            continue;
+        for (const benchResult& result : results)
+        {
+            if (result.name != name)
+                continue;
+            bool regressed = result.nsPerOp > baselineNs * (1 + tolerance / 100);
+            fprintf(stderr, "%-32s %10.2f -> %10.2f ns/op %+7.1f%%%s\n", name, baselineNs, result.nsPerOp,
+                (result.nsPerOp / baselineNs - 1) * 100, regressed ? "  regression" : "");
+            logRatios += log(result.nsPerOp / baselineNs);
+            compared++;
+            regressions += regressed;
+        }
+    }
+    fclose(file);
+
+    if (compared > 0)
+        fprintf(stderr, "%d benchmarks compared, geometric mean %+.1f%% ns/op, %d regressions\n", compared,
+            (exp(logRatios / compared) - 1) * 100, regressions);
+    return regressions;
+}
+
+// Batch throughput: many instances advanced round-robin in slices, like a fuzzing or RL worker.
+// The working set of all instances exceeds L1, so the state layout shows up in the miss counts.
+static void benchBatch(const std::vector<uint8_t>& rom, int instances, int slice, int rounds, bool useIR)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "batch%d/%s", instances, useIR ? "ir" : "interp");
+    if (!isSelected(name))
+        return;
+
+    chip8Pool pool;
+    int romId = pool.addRom(rom.data(), rom.size());
+    std::vector<chip8*> batch;
+    for (int i = 0; i < instances; i++)
+        batch.push_back(pool.acquire(romId, i + 1));
+
+#ifdef __linux__
+    cacheMissCounter l1Misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    cacheMissCounter llcMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#else
+    cacheMissCounter l1Misses(0, 0);
+    cacheMissCounter llcMisses(0, 0);
+#endif
+
+    uint64_t instructions = 0;
+    l1Misses.start();
+    llcMisses.start();
+    benchClock::time_point start = benchClock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < instances; i++)
+        {
+            chip8* c8 = batch[i];
+            uint64_t target = c8->getExecutedInstructions() + slice;
+            if (useIR)
+                while (c8->getExecutedInstructions() < target)
+                    c8->executeBlock();
+            else
+                c8->executeInstructions(slice);
+        }
+    }
+    double seconds = std::chrono::duration<double>(benchClock::now() - start).count();
+    uint64_t l1 = l1Misses.stop();
+    uint64_t llc = llcMisses.stop();
+
+    for (int i = 0; i < instances; i++)
+    {
+        instructions += batch[i]->getExecutedInstructions();
+        pool.release(batch[i]);
+    }
+
+    report(name, seconds, instructions, instructions,
+        l1Misses.isAvailable() ? l1 * 1000.0 / instructions : -1, llcMisses.isAvailable() ? llc * 1000.0 / instructions : -1);
+}
+
+// reset cost after a run of runInstructions: full initialize + load vs pooled O(dirty) reset
+static void benchReset(const std::vector<uint8_t>& rom, int resets, int runInstructions)
+{
+    char fullName[64];
+    char pooledName[64];
+    snprintf(fullName, sizeof(fullName), "reset/full/run%d", runInstructions);
+    snprintf(pooledName, sizeof(pooledName), "reset/pool/run%d", runInstructions);
+    if (!isSelected(fullName) && !isSelected(pooledName))
+        return;
+
+    double fullSeconds = 0;
+    chip8* full = new chip8();
+    full->loadROM(rom.data(), rom.size());
+    for (int i = 0; i < resets; i++)
+    {
+        full->executeInstructions(runInstructions);
+
+        benchClock::time_point start = benchClock::now();
+        full->loadROM(rom.data(), rom.size());
+        fullSeconds += std::chrono::duration<double>(benchClock::now() - start).count();
+    }
+    delete full;
+
+    double pooledSeconds = 0;
+    chip8Pool pool;
+    int romId = pool.addRom(rom.data(), rom.size());
+    chip8* pooled = pool.acquire(romId, 1);
+    for (int i = 0; i < resets; i++)
+    {
+        pooled->executeInstructions(runInstructions);
+
+        benchClock::time_point start = benchClock::now();
+        pool.reset(pooled, i + 1);
+        pooledSeconds += std::chrono::duration<double>(benchClock::now() - start).count();
+    }
+    pool.release(pooled);
+
+    if (isSelected(fullName))
+        report(fullName, fullSeconds, resets);
+    if (isSelected(pooledName))
+        report(pooledName, pooledSeconds, resets);
+}
+
+// vectorized environment: frames per second with actions, probes and observations, one thread
+static void benchEnv(const std::vector<uint8_t>& rom, int instances, int steps, observationFormat format)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "env%d/%s", instances, format == OBSERVATION_PACKED ? "packed" : "unpacked");
+    if (!isSelected(name))
+        return;
+
+    envConfig config;
+    config.format = format;
+    config.maxEpisodeFrames = 1000;
+    chip8VectorEnv env(instances, config);
+    env.loadROM(rom.data(), rom.size());
+    rewardProbe score = { 0x400, 3, true, REWARD_DELTA, 1.0f };
+    env.addRewardProbe(score);
+
+    std::vector<uint8_t> observations(env.getObservationSize() * instances);
+    std::vector<uint16_t> actions(instances);
+    std::vector<float> rewards(instances);
+    std::vector<uint8_t> done(instances);
+    env.reset(1, observations.data());
+
+    benchClock::time_point start = benchClock::now();
+    for (int step = 0; step < steps; step++)
+    {
+        for (int i = 0; i < instances; i++)
+            actions[i] = (uint16_t)(1 << ((step + i) % KEYS_NUMBER));
+        env.step(actions.data(), observations.data(), rewards.data(), done.data());
+    }
+    double seconds = std::chrono::duration<double>(benchClock::now() - start).count();
+    report(name, seconds, (uint64_t)steps * instances);
+}
+
+int main(int argc, char **argv)
+{
+    const char* baselineFileName = NULL;
+    double tolerance = BENCH_DEFAULT_TOLERANCE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            jsonOutput = true;
+        else if (strcmp(argv[i], "--quick") == 0)
+            workDivisor = 10;
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+            nameFilter = argv[i] + 9;
+        else if (strncmp(argv[i], "--baseline=", 11) == 0)
+            baselineFileName = argv[i] + 11;
+        else if (strncmp(argv[i], "--tolerance=", 12) == 0)
+            tolerance = atof(argv[i] + 12);
+        else
+        {
+            printf("Usage: chip8-bench [--json] [--quick] [--filter=prefix] [--baseline=results.json] [--tolerance=percent]\n");
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> rom = buildRom(workloadProgram, sizeof(workloadProgram) / sizeof(workloadProgram[0]));
+
+    benchDispatch(false);
+    benchDispatch(true);
+    benchDraw();
+    benchMemoryOpcodes();
+    benchTimers();
+    benchFramebuffer();
+    benchSnapshots();
+
+    benchCorpus(false);
+    benchCorpus(true);
+
+    benchReset(rom, scaled(100000), 20);
+    benchReset(rom, scaled(100000), 2000);
+
+    benchBatch(rom, 1, 1000, scaled(20000), false);
+    benchBatch(rom, 1, 1000, scaled(20000), true);
+    benchBatch(rom, 256, 200, scaled(400), false);
+    benchBatch(rom, 256, 200, scaled(400), true);
+
+    benchEnv(rom, 64, scaled(2000), OBSERVATION_PACKED);
+    benchEnv(rom, 64, scaled(2000), OBSERVATION_UNPACKED);
+
+    if (jsonOutput)
+        writeJson(stdout);
+
+    if (baselineFileName != NULL)
+    {
+        fflush(stdout);
+        int regressions = compareBaseline(baselineFileName, tolerance);
+        if (regressions < 0)
+        {
+            fprintf(stderr, "Cannot read %s\n", baselineFileName);
+            return 1;
+        }
+        if (regressions > 0)
+            return 2;
+    }
+    return 0;
+}
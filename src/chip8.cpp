@@ -1,23 +1,113 @@
 #include "chip8.h"
+#include "chip8_ir.h"
 #include <cstdio>
 #include <vector>
 #include <cstdlib>
-#include <ctime>
-#include <iostream>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 
+// built-in 4x5 font, copied into memory at 0x0000 by initialize()
+static const uint8_t fontset[FONTSET_SIZE] =
+{
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// SUPER-CHIP 8x10 digits, copied to BIG_FONTSET_ADDRESS; FX30 points I at them
+static const uint8_t bigFontset[BIG_FONTSET_SIZE] =
+{
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C  // 9
+};
+
+chip8::~chip8()
+{
+    delete ir;
+    delete sprites;
+    delete[] fusionKinds;
+}
+
+void chip8::saveState(chip8State& snapshot) const
+{
+    memcpy(&snapshot, static_cast<const chip8State*>(this), offsetof(chip8State, memory) + getMemorySize());
+}
+
+void chip8::loadState(const chip8State& snapshot)
+{
+    memcpy(static_cast<chip8State*>(this), &snapshot, offsetof(chip8State, memory) + getMemorySize());
+
+    // the snapshot's memory may differ anywhere from what the caches and dirty bits describe
+    invalidateCaches();
+    markMemoryDirty();
+    dirtyDisplayRows = ~0ULL;
+}
+
+// sets the dirty bit of every addressable page
+void chip8::markMemoryDirty()
+{
+    for (int i = 0; i < (MEMORY_PAGES + 63) / 64; i++)
+        dirtyPages[i] = i < getMemoryPageWords() ? ~0ULL : 0;
+}
+
 // Initialize registers, timers, memory, etc.
 void chip8::initialize()
+{
+    resetRegisters();
+
+    // clear display
+    memset(display, 0, sizeof(display));
+    dirtyDisplayRows = ~0ULL;
+
+    // clear memory 
+    memset(memory, 0, getMemorySize());
+    markMemoryDirty();
+
+    // translated blocks, sprites and superinstructions refer to the old memory contents
+    invalidateCaches();
+
+    // load fontset (in memory: 0x0000 - 0x0050)
+    for (int i = 0; i < FONTSET_SIZE; i++)
+        memory[i] = fontset[i];
+    for (int i = 0; i < BIG_FONTSET_SIZE; i++)
+        memory[BIG_FONTSET_ADDRESS + i] = bigFontset[i];
+
+    // for 0xCXNN opcode; fixed, so that a loaded machine is deterministic until the host reseeds it
+    seedRandom(CHIP8_DEFAULT_SEED);
+}
+
+// registers, stack, timers and keys as they are right after loading
+void chip8::resetRegisters()
 {
     pc = 0x0200;    // program is placed at 0x0200 
     opcode = 0;
     I = 0;
     stackLevel = 0;
 
-    // clear display
-    for (int i = 0; i < GRAPHICS_PIXEL_RESOL; i++)
-        displayScreen[i] = 0;
-    
     // clear stack array
     for (int i = 0; i < STACK_LEVELS; i++)
         stack[i] = 0;
@@ -26,88 +116,247 @@ void chip8::initialize()
     for (int i = 0; i < REGS_NUMBER; i++)
         V[i] = 0;
 
-    // clear memory 
-    for (int i = 0; i < MEMORY_SIZE; i++)
-        memory[i] = 0;
-
-    // load fontset (in memory: 0x0000 - 0x0050)
-    for (int i = 0; i < FONTSET_SIZE; i++)
-        memory[i] = fontset[i];
-
     // reset timers
     delayTimer = 0;
     soundTimer = 0;
 
+    waitingForKey = false;
+    keyWaitRegister = 0;
+    halted = false;
+
+    executedInstructions = 0;
+    fusedInstructions = 0;
+
+    // release all keys
+    for (int i = 0; i < KEYS_NUMBER; i++)
+        key[i] = 0;
+    keyReads = 0;
+
+    for (int i = 0; i < RPL_FLAGS_NUMBER; i++)
+        rplFlags[i] = 0;
+    for (int i = 0; i < AUDIO_PATTERN_SIZE; i++)
+        audioPattern[i] = 0;
+    pitch = 64;     // 4000 Hz playback
+    audioPatternLoaded = false;
+
+    hires = false;
+    planeMask = 0x1;
     drawFlag = true;
+}
 
-    // for 0xCXNN opcode 
-    srand(time(0));
+static inline int lowestBitIndex(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
 }
 
-bool chip8::loadGame(const char* gameFileName)
+// Returns to the state right after loading at the cost of what changed since then: only the pages
+// written since the load or the previous reset are copied back from pristineMemory (a
+// getMemorySize() image taken after loadROM) and only the changed display rows are cleared.
+void chip8::reset(const uint8_t* pristineMemory, uint32_t seed)
 {
-    initialize();
-    FILE* fp = fopen(gameFileName, "rb");
-    if (fp == NULL)
+    resetRegisters();
+
+    for (int word = 0; word < getMemoryPageWords(); word++)
     {
-        std::cerr << "Failed to open the file!\n";
-        return false;
+        for (uint64_t bits = dirtyPages[word] | resetPages[word]; bits != 0; bits &= bits - 1)
+        {
+            int page = word * 64 + lowestBitIndex(bits);
+
+            memcpy(&memory[page * MEMORY_PAGE_SIZE], &pristineMemory[page * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE);
+            invalidatePage(page);
+        }
     }
-    
-    // get the size of file
-    fseek(fp, 0L, SEEK_END);
-    int size = ftell(fp);
-    fseek(fp, 0L, SEEK_SET);
-    std::cout << "Filesize: " << size << "\n";
-    
-    uint8_t* buffer = (uint8_t*)malloc(size);
-    if (buffer == NULL)
+
+    uint64_t rows = dirtyDisplayRows | resetDisplayRows;
+    for (int row = 0; row < DISPLAY_HIRES_HEIGHT; row++)
+        if (rows & (1ULL << row))
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+                memset(display[plane][row], 0, sizeof(display[plane][row]));
+
+    clearDirtyPages();
+    clearResetPages();
+    seedRandom(seed);
+}
+
+// the machine matches the pristine image again
+void chip8::clearResetPages()
+{
+    for (int i = 0; i < (MEMORY_PAGES + 63) / 64; i++)
+        resetPages[i] = 0;
+    resetDisplayRows = 0;
+}
+
+void chip8::seedRandom(uint32_t seed)
+{
+    // xorshift state must not be zero
+    randomState = seed != 0 ? seed : 0x9E3779B9;
+}
+
+bool chip8::loadROM(const uint8_t* data, size_t size)
+{
+    initialize();
+
+    if (size > getMemorySize() - 0x0200)
     {
-        std::cerr << "Failed to allocate memory for buffer.\n";
+        if (logger != NULL)
+            logger->log(LOG_ERROR, LOG_ROM_TOO_BIG, this, 0, 0, (uint32_t)size);
         return false;
     }
-    std::fread(&buffer[0], sizeof(buffer[0]), size, fp);
+    memcpy(&memory[0x0200], data, size);
+    onMemoryWrite(0x0200, (uint16_t)size);
+
+    // this is the image reset() returns to; the dirty bits still show the whole load
+    clearResetPages();
 
-    if (size > (0x1000 - 0x0200)) 
+    return true;
+}
+
+void chip8::setQuirkProfile(quirkProfile profile)
+{
+    quirks = profile;
+    switch (profile)
     {
-        std::cerr << "Application ROM is too big.\n";
-        return false;
+        case QUIRKS_COSMAC_VIP:
+            cycleFn = &chip8::executeCycleFor<cosmacVipQuirks>;
+            opcodeFn = &chip8::executeOpcodeFor<cosmacVipQuirks>;
+            break;
+        case QUIRKS_CHIP48:
+            cycleFn = &chip8::executeCycleFor<chip48Quirks>;
+            opcodeFn = &chip8::executeOpcodeFor<chip48Quirks>;
+            break;
+        case QUIRKS_SUPER_CHIP:
+            cycleFn = &chip8::executeCycleFor<superChipQuirks>;
+            opcodeFn = &chip8::executeOpcodeFor<superChipQuirks>;
+            break;
+        case QUIRKS_XO_CHIP:
+            cycleFn = &chip8::executeCycleFor<xoChipQuirks>;
+            opcodeFn = &chip8::executeOpcodeFor<xoChipQuirks>;
+            break;
+        default:
+            quirks = QUIRKS_MODERN;
+            cycleFn = &chip8::executeCycleFor<modernQuirks>;
+            opcodeFn = &chip8::executeOpcodeFor<modernQuirks>;
     }
-    for (int i = 0; i < size; i++)
-        memory[i + 0x0200] = buffer[i];
 
-    free(buffer);
-    fclose(fp);
+    // translated blocks were decoded with the previous profile's semantics
+    if (ir != NULL)
+        ir->clear();
 
-    return true;
+    // superinstructions are matched per addressable byte
+    uint16_t newMask = getQuirkSettings(quirks).memoryMask;
+    if (fusionKinds != NULL && newMask != memoryMask)
+    {
+        delete[] fusionKinds;
+        fusionKinds = NULL;
+    }
+    memoryMask = newMask;
 }
 
-void chip8::executeCycle()
+template <class Quirks>
+void chip8::executeCycleFor(int budget)
 {
+    // halted by FX0A: nothing to fetch until setKey() delivers a key press
+    if (waitingForKey || halted)
+        return;
+
+    if (executeFused<Quirks>(budget))
+        return;
+
     // read 2-byte opcode at the address of program counter
-    opcode = (memory[pc] << 8) | memory[pc + 1];
+    opcode = (memory[pc & Quirks::memoryMask] << 8) | memory[(pc + 1) & Quirks::memoryMask];
+    executedInstructions++;
 
+    executeOpcodeFor<Quirks>();
+}
+
+uint64_t chip8::executeInstructions(uint64_t count)
+{
+    uint64_t start = executedInstructions;
+    uint64_t end = start + count;
+    while (executedInstructions < end && !waitingForKey && !halted)
+    {
+        uint64_t remaining = end - executedInstructions;
+        (this->*cycleFn)(remaining < FUSED_MAX_INSTRUCTIONS ? (int)remaining : FUSED_MAX_INSTRUCTIONS);
+    }
+    return executedInstructions - start;
+}
+
+int chip8::executeBlock()
+{
+    if (ir == NULL)
+        ir = new chip8IR();
+
+    return ir->executeBlock(*this);
+}
+
+// executes the already fetched opcode with the semantics of the Quirks profile
+template <class Quirks>
+void chip8::executeOpcodeFor()
+{
     // initially look at the first 4 bits of opcode
     switch (opcode & 0xF000)
     {
         case 0x0000:
         {
+            if ((opcode & 0xFFF0) == 0x00C0)    // 0x00CN scrolls the display down by N pixels (SUPER-CHIP)
+            {
+                scrollDisplay(opcode & 0x000F, 0);
+                pc += 2;
+                break;
+            }
+            if ((opcode & 0xFFF0) == 0x00D0)    // 0x00DN scrolls the display up by N pixels (XO-CHIP)
+            {
+                scrollDisplay(-(opcode & 0x000F), 0);
+                pc += 2;
+                break;
+            }
+
             switch (opcode & 0x00FF) 
             {
                 case 0x00E0:    // 0x00E0 clears the screen
-                    for (int i = 0; i < GRAPHICS_PIXEL_RESOL; i++)
-                        displayScreen[i] = 0;
-                    drawFlag = true;
+                    clearDisplay();
                     pc += 2;
                     break;
                 
                 case 0x00EE:    // 0x00EE returns from a subroutine
-                    pc = stack[--stackLevel];
+                    pc = stack[--stackLevel % STACK_LEVELS];
+                    pc += 2;
+                    break;
+
+                case 0x00FB:    // 0x00FB scrolls the display right by 4 pixels (SUPER-CHIP)
+                    scrollDisplay(0, 4);
+                    pc += 2;
+                    break;
+
+                case 0x00FC:    // 0x00FC scrolls the display left by 4 pixels (SUPER-CHIP)
+                    scrollDisplay(0, -4);
+                    pc += 2;
+                    break;
+
+                case 0x00FD:    // 0x00FD exits the interpreter (SUPER-CHIP)
+                    if (logger != NULL)
+                        logger->log(LOG_INFO, LOG_PROGRAM_EXIT, this, pc, opcode);
+                    halted = true;
+                    break;
+
+                case 0x00FE:    // 0x00FE switches to 64x32 (SUPER-CHIP)
+                    setResolution(false);
+                    pc += 2;
+                    break;
+
+                case 0x00FF:    // 0x00FF switches to 128x64 (SUPER-CHIP)
+                    setResolution(true);
                     pc += 2;
                     break;
 
                 default:        // 0x0NNN call machine code routine at address NNN
-                    std::cerr << "Unknown opcode - " << opcode << " !\n";
+                    onUnknownOpcode();
             }
             break;
         }
@@ -118,7 +367,7 @@ void chip8::executeCycle()
         }
         case 0x2000:            // 0x2NNN CALLS a subroutine at NNN
         {   
-            stack[stackLevel++] = pc;
+            stack[stackLevel++ % STACK_LEVELS] = pc;
             pc = opcode & 0x0FFF;
             break;
         }
@@ -127,7 +376,7 @@ void chip8::executeCycle()
             uint8_t regNumber = (opcode & 0x0F00) >> 8;
             uint8_t numberToCompare = opcode & 0x00FF;
             if ( V[regNumber] == numberToCompare )
-                pc += 2;
+                skipNextInstruction();
             pc += 2;
             break;
         }
@@ -136,17 +385,37 @@ void chip8::executeCycle()
             uint8_t regNumber = (opcode & 0x0F00) >> 8;
             uint8_t numberToCompare = opcode & 0x00FF;
             if ( V[regNumber] != numberToCompare )
-                pc += 2;
+                skipNextInstruction();
             pc += 2;
             break;
         }
-        case 0x5000:            // 0x5XY0 skips the next instruction if VX != VY
+        case 0x5000:
         {    
             uint8_t regNumberX = (opcode & 0x0F00) >> 8;
             uint8_t regNumberY = (opcode & 0x00F0) >> 4;
-            if ( V[regNumberX] != V[regNumberY] )
-                pc += 2;
-            pc += 2;
+            int count = (regNumberX < regNumberY ? regNumberY - regNumberX : regNumberX - regNumberY) + 1;
+            int step = regNumberX < regNumberY ? 1 : -1;
+            switch (opcode & 0x000F)
+            {
+                case 0x0000:    // 0x5XY0 skips the next instruction if VX != VY
+                    if ( V[regNumberX] != V[regNumberY] )
+                        skipNextInstruction();
+                    pc += 2;
+                    break;
+                case 0x0002:    // 0x5XY2 stores VX to VY (in either order) in memory, starting at address I (XO-CHIP)
+                    for (int i = 0; i < count; i++)
+                        memory[(I + i) & Quirks::memoryMask] = V[regNumberX + i * step];
+                    onMemoryWrite(I, count);
+                    pc += 2;
+                    break;
+                case 0x0003:    // 0x5XY3 fills VX to VY (in either order) with values from memory, starting at address I (XO-CHIP)
+                    for (int i = 0; i < count; i++)
+                        V[regNumberX + i * step] = memory[(I + i) & Quirks::memoryMask];
+                    pc += 2;
+                    break;
+                default:
+                    onUnknownOpcode();
+            }
             break;
         }
         case 0x6000:            // 0x6XNN sets VX to NN
@@ -180,6 +449,8 @@ void chip8::executeCycle()
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
                     uint8_t regNumberY = (opcode & 0x00F0) >> 4;
                     V[regNumberX] |= V[regNumberY];
+                    if (Quirks::logicResetsVF)
+                        V[0xF] = 0;
                     pc += 2;
                     break;
                 }
@@ -188,6 +459,8 @@ void chip8::executeCycle()
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
                     uint8_t regNumberY = (opcode & 0x00F0) >> 4;
                     V[regNumberX] &= V[regNumberY];
+                    if (Quirks::logicResetsVF)
+                        V[0xF] = 0;
                     pc += 2;
                     break;
                 }
@@ -196,6 +469,8 @@ void chip8::executeCycle()
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
                     uint8_t regNumberY = (opcode & 0x00F0) >> 4;
                     V[regNumberX] ^= V[regNumberY];
+                    if (Quirks::logicResetsVF)
+                        V[0xF] = 0;
                     pc += 2;
                     break;
                 }
@@ -223,11 +498,12 @@ void chip8::executeCycle()
                     pc += 2;
                     break;
                 }
-                case 0x0006:    // 0x8XY6 stores the least significant bit of VX in VF and then shifts VX to the right by 1
+                case 0x0006:    // 0x8XY6 stores the least significant bit of VX (VY on the VIP) in VF and then sets VX to it shifted right by 1
                 {    
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-                    V[0xF] = V[regNumberX] & 0x01;
-                    V[regNumberX] >>= 1;
+                    uint8_t value = V[Quirks::shiftUsesVY ? (opcode & 0x00F0) >> 4 : regNumberX];
+                    V[0xF] = value & 0x01;
+                    V[regNumberX] = value >> 1;
                     pc += 2;
                     break;
                 }
@@ -243,16 +519,17 @@ void chip8::executeCycle()
                     pc += 2;
                     break;
                 }
-                case 0x000E:    // 0x8XYE stores the most significant bit of VX in VF and then shifts VX to the left by 1
+                case 0x000E:    // 0x8XYE stores the most significant bit of VX (VY on the VIP) in VF and then sets VX to it shifted left by 1
                 {   
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-                    V[0xF] = (V[regNumberX] & 0x80) >> 7;
-                    V[regNumberX] <<= 1;
+                    uint8_t value = V[Quirks::shiftUsesVY ? (opcode & 0x00F0) >> 4 : regNumberX];
+                    V[0xF] = (value & 0x80) >> 7;
+                    V[regNumberX] = value << 1;
                     pc += 2;
                     break;
                 }
                 default:
-                    printf("Unknown opcode: 0x%04X\n", opcode);
+                    onUnknownOpcode();
             }
             break;
         }
@@ -261,7 +538,7 @@ void chip8::executeCycle()
             uint8_t regNumberX = (opcode & 0x0F00) >> 8;
             uint8_t regNumberY = (opcode & 0x00F0) >> 4;
             if ( V[regNumberX] != V[regNumberY] )
-                pc += 2;
+                skipNextInstruction();
             pc += 2;
             break;
         }
@@ -271,45 +548,21 @@ void chip8::executeCycle()
             pc += 2;
             break;
         }
-        case 0xB000:            // 0xBNNN jumps to the address NNN plus V0
+        case 0xB000:            // 0xBNNN jumps to the address NNN plus V0 (0xBXNN: XNN plus VX on CHIP-48 / SUPER-CHIP)
         {
-            pc = (opcode & 0x0FFF) + V[0];
+            pc = (opcode & 0x0FFF) + V[Quirks::jumpUsesVX ? (opcode & 0x0F00) >> 8 : 0];
             break;
         }
         case 0xC000:            // 0xCXNN sets VX to the result of a bitwise AND operation on a random number (Typically: 0 to 255) and NN
         {            
             uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-            V[regNumberX] = (opcode & 0x00FF) & (uint8_t)(rand() % 0xFF);
+            V[regNumberX] = (opcode & 0x00FF) & nextRandom();
             pc += 2;
             break;
         }
-        case 0xD000:            // 0xDXYN draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels
+        case 0xD000:            // 0xDXYN draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels (DXY0: 16x16)
         {
-            uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-            uint8_t regNumberY = (opcode & 0x00F0) >> 4;
-
-            uint8_t x = V[regNumberX];
-            uint8_t y = V[regNumberY];
-
-            uint8_t height = opcode & 0x000F;
-            uint8_t pixel;  // one row of 8 pixels
-
-            V[0xF] = 0;
-            for (int yLine = 0; yLine < height; yLine++)
-            {
-                pixel = memory[I + yLine];
-                for (int xLine = 0; xLine < 8; xLine++)
-                {
-                    if ( (pixel & (0x80 >> xLine) ) != 0)
-                    {
-                        if (displayScreen[ (y + yLine) * DISPLAY_HEIGHT_PIXELS + x + xLine] == 1)
-                            V[0xF] = 1;
-                        displayScreen[ (y + yLine) * DISPLAY_HEIGHT_PIXELS + x + xLine] ^= 1 /* (pixel & (0x80 >> xLine) ) */;
-                    }
-                }
-            }
-
-            drawFlag = true;
+            drawSprite<Quirks::spritesWrap>((opcode & 0x0F00) >> 8, (opcode & 0x00F0) >> 4, opcode & 0x000F);
             pc += 2;
             break;
         }
@@ -320,19 +573,23 @@ void chip8::executeCycle()
                 case 0x0090:    // 0xEX9E skips the next instruction if the key stored in VX is pressed
                 {
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-                    if (key[ V[regNumberX] ] != 0)
-                        pc += 2;
+                    keyReads++;
+                    if (key[ V[regNumberX] & 0x0F ] != 0)
+                        skipNextInstruction();
                     pc += 2;
                     break;
                 }
                 case 0x00A0:    // 0xEXA1 skips the next instruction if the key stored in VX is not pressed
                 {
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-                    if (key[ V[regNumberX] ] == 0)
-                        pc += 2;
+                    keyReads++;
+                    if (key[ V[regNumberX] & 0x0F ] == 0)
+                        skipNextInstruction();
                     pc += 2;
                     break;
                 }
+                default:
+                    onUnknownOpcode();
             }
             break;
         }
@@ -340,6 +597,26 @@ void chip8::executeCycle()
         {
             switch (opcode & 0x00FF)
             {
+                case 0x0000:    // 0xF000 0xNNNN sets I to the 16-bit address NNNN (XO-CHIP)
+                {
+                    I = (memory[(pc + 2) & Quirks::memoryMask] << 8) | memory[(pc + 3) & Quirks::memoryMask];
+                    pc += 4;
+                    break;
+                }
+                case 0x0001:    // 0xFN01 selects the bit planes drawn to by DXYN, 00E0 and the scrolls (XO-CHIP)
+                {
+                    planeMask = ((opcode & 0x0F00) >> 8) & 0x3;
+                    pc += 2;
+                    break;
+                }
+                case 0x0002:    // 0xF002 loads the 16-byte audio pattern from address I (XO-CHIP)
+                {
+                    for (int i = 0; i < AUDIO_PATTERN_SIZE; i++)
+                        audioPattern[i] = memory[(I + i) & Quirks::memoryMask];
+                    audioPatternLoaded = true;
+                    pc += 2;
+                    break;
+                }
                 case 0x0007:    // 0xFX07 sets VX to the value of the delay timer
                 {
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
@@ -349,22 +626,9 @@ void chip8::executeCycle()
                 }
                 case 0x000A:    // 0xFX0A a key press is awaited, and then stored in VX
                 {
-                    bool keyPressed = false;
-
-                    uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-                    for (int i = 0; i < KEYS_NUMBER; i++)
-                    {
-                        if (key[i] != 0)
-                        {
-                            V[regNumberX] = i;
-                            keyPressed = true;
-                        }
-                    }
-
-                    if (!keyPressed)
-                        return;
-
-                    pc += 2;
+                    // enter the halt state; setKey() stores the key and moves pc past this opcode
+                    keyWaitRegister = (opcode & 0x0F00) >> 8;
+                    waitingForKey = true;
                     break;
                 }
                 case 0x0015:    // 0xFX15 sets the delay timer to VX
@@ -399,12 +663,27 @@ void chip8::executeCycle()
                     pc += 2;
                     break;
                 }
+                case 0x0030:    // 0xFX30 sets I to the location of the 8x10 digit in VX (SUPER-CHIP)
+                {
+                    uint8_t regNumberX = (opcode & 0x0F00) >> 8;
+                    I = BIG_FONTSET_ADDRESS + (V[regNumberX] % 10) * 10;
+                    pc += 2;
+                    break;
+                }
+                case 0x003A:    // 0xFX3A sets the audio pattern pitch to VX (XO-CHIP)
+                {
+                    uint8_t regNumberX = (opcode & 0x0F00) >> 8;
+                    pitch = V[regNumberX];
+                    pc += 2;
+                    break;
+                }
                 case 0x0033:    // 0xFX33 stores the binary-coded decimal representation of VX
                 {
                     uint8_t regNumberX = (opcode & 0x0F00) >> 8;
-                    memory[I + 0] = V[regNumberX] / 100;
-                    memory[I + 1] = (V[regNumberX] / 10) % 10;
-                    memory[I + 2] = V[regNumberX] % 10;
+                    memory[(I + 0) & Quirks::memoryMask] = V[regNumberX] / 100;
+                    memory[(I + 1) & Quirks::memoryMask] = (V[regNumberX] / 10) % 10;
+                    memory[(I + 2) & Quirks::memoryMask] = V[regNumberX] % 10;
+                    onMemoryWrite(I, 3);
                     pc += 2;
                     break;
                 }
@@ -413,9 +692,11 @@ void chip8::executeCycle()
                     int8_t regNumberX = (opcode & 0x0F00) >> 8;
                     for (int i = 0; i <= regNumberX; i++)
                     {
-                        memory[I + i] = V[i];
+                        memory[(I + i) & Quirks::memoryMask] = V[i];
                     }
-                    I += regNumberX + 1;
+                    onMemoryWrite(I, regNumberX + 1);
+                    if (Quirks::indexIncrement != INDEX_UNCHANGED)
+                        I += Quirks::indexIncrement == INDEX_PLUS_X ? regNumberX : regNumberX + 1;
                     pc += 2;
                     break;
                 }
@@ -424,28 +705,447 @@ void chip8::executeCycle()
                     int8_t regNumberX = (opcode & 0x0F00) >> 8;
                     for (int i = 0; i <= regNumberX; i++)
                     {
-                        V[i] = memory[I + i];
+                        V[i] = memory[(I + i) & Quirks::memoryMask];
                     }
-                    I += regNumberX + 1;
+                    if (Quirks::indexIncrement != INDEX_UNCHANGED)
+                        I += Quirks::indexIncrement == INDEX_PLUS_X ? regNumberX : regNumberX + 1;
+                    pc += 2;
+                    break;
+                }
+                case 0x0075:    // 0xFX75 stores V0 to VX in the RPL user flags (SUPER-CHIP)
+                {
+                    uint8_t regNumberX = (opcode & 0x0F00) >> 8;
+                    for (int i = 0; i <= regNumberX; i++)
+                        rplFlags[i] = V[i];
                     pc += 2;
                     break;
                 }
+                case 0x0085:    // 0xFX85 fills V0 to VX from the RPL user flags (SUPER-CHIP)
+                {
+                    uint8_t regNumberX = (opcode & 0x0F00) >> 8;
+                    for (int i = 0; i <= regNumberX; i++)
+                        V[i] = rplFlags[i];
+                    pc += 2;
+                    break;
+                }
+                default:
+                    onUnknownOpcode();
             }
             break;
         }
         default:
-            printf("Unknown opcode: 0x%04X\n", opcode);
+            onUnknownOpcode();
     }
+}
+
+// applies the unknown opcode policy to the opcode at pc
+void chip8::onUnknownOpcode()
+{
+    if (logger != NULL)
+        logger->log(LOG_WARNING, LOG_UNKNOWN_OPCODE, this, pc, opcode);
+
+    bool skip = unknownPolicy == UNKNOWN_OPCODE_SKIP;
+    if (unknownPolicy == UNKNOWN_OPCODE_TRAP && unknownHandler != NULL)
+        skip = unknownHandler(*this, pc, opcode, unknownHandlerContext);
+
+    if (skip)
+        pc += 2;
+    else
+        halted = true;
+}
+
+// skips the instruction after the current one; the XO-CHIP F000 NNNN is 4 bytes long
+void chip8::skipNextInstruction()
+{
+    pc += isLongInstruction(pc + 2) ? 4 : 2;
+}
+
+// Superinstructions: recurring opcode pairs (and one triple) are matched once per address and
+// executed with a single dispatch. Each pattern is straight-line code, so the result is the same
+// as executing the opcodes one by one; budget is the most instructions the cycle may retire.
+template <class Quirks>
+bool chip8::executeFused(int budget)
+{
+    if (budget < 2 || pc + 5 > Quirks::memoryMask)
+        return false;
+
+    if (fusionKinds == NULL)
+        fusionKinds = new uint8_t[Quirks::memoryMask + 1]();
+    uint8_t kind = fusionKinds[pc];
+    if (kind == FUSION_UNMATCHED)
+        kind = fusionKinds[pc] = matchFusion(pc);
+    if (kind == FUSION_NONE)
+        return false;
+
+    uint16_t first = (memory[pc] << 8) | memory[pc + 1];
+    uint16_t second = (memory[pc + 2] << 8) | memory[pc + 3];
+    uint8_t regNumberX = (first & 0x0F00) >> 8;
+
+    switch (kind)
+    {
+        case FUSION_SET_DRAW:   // 0x6XNN 0x6YNN 0xDXYN sets sprite coordinates and draws
+        case FUSION_SET_PAIR:   // 0x6XNN 0x6YNN
+        {
+            V[regNumberX] = first & 0x00FF;
+            V[(second & 0x0F00) >> 8] = second & 0x00FF;
+            opcode = second;
+            pc += 4;
+
+            // without the budget for the draw it runs as the next cycle
+            if (kind == FUSION_SET_DRAW && budget >= 3)
+            {
+                uint16_t third = (memory[pc] << 8) | memory[pc + 1];
+                opcode = third;
+                drawSprite<Quirks::spritesWrap>((third & 0x0F00) >> 8, (third & 0x00F0) >> 4, third & 0x000F);
+                pc += 2;
+                executedInstructions += 3;
+                fusedInstructions += 3;
+                return true;
+            }
+            break;
+        }
+        case FUSION_COUNT_TEST: // 0x7XNN 0x3XNN increments a loop counter and tests it
+        {
+            V[regNumberX] += first & 0x00FF;
+            opcode = second;
+            pc += (V[regNumberX] == (second & 0x00FF)) ? 6 : 4;
+            break;
+        }
+        case FUSION_SPRITE:     // 0xANNN 0xDXYN points I at a sprite and draws it
+        {
+            I = first & 0x0FFF;
+            opcode = second;
+            drawSprite<Quirks::spritesWrap>((second & 0x0F00) >> 8, (second & 0x00F0) >> 4, second & 0x000F);
+            pc += 4;
+            break;
+        }
+        case FUSION_POLL_DELAY: // 0xFX07 0x3X00 polls the delay timer
+        {
+            V[regNumberX] = delayTimer;
+            opcode = second;
+            pc += (V[regNumberX] == 0) ? 6 : 4;
+            break;
+        }
+    }
+
+    executedInstructions += 2;
+    fusedInstructions += 2;
+    return true;
+}
+
+// the superinstruction starting at address; only reads the 6 bytes from there
+uint8_t chip8::matchFusion(uint16_t address) const
+{
+    uint16_t first = (memory[address] << 8) | memory[address + 1];
+    uint16_t second = (memory[address + 2] << 8) | memory[address + 3];
+    uint8_t regNumberX = (first & 0x0F00) >> 8;
+
+    switch (first & 0xF000)
+    {
+        case 0x6000:
+            if ((second & 0xF000) != 0x6000)
+                return FUSION_NONE;
+            return memory[address + 4] >> 4 == 0xD ? FUSION_SET_DRAW : FUSION_SET_PAIR;
+        case 0x7000:
+            if ((second & 0xF000) != 0x3000 || ((second & 0x0F00) >> 8) != regNumberX || isLongInstruction(address + 4))
+                return FUSION_NONE;
+            return FUSION_COUNT_TEST;
+        case 0xA000:
+            return (second & 0xF000) == 0xD000 ? FUSION_SPRITE : FUSION_NONE;
+        case 0xF000:
+            if ((first & 0x00FF) != 0x0007 || (second & 0xF0FF) != 0x3000 || ((second & 0x0F00) >> 8) != regNumberX
+                || isLongInstruction(address + 4))
+                return FUSION_NONE;
+            return FUSION_POLL_DELAY;
+        default:
+            return FUSION_NONE;
+    }
+}
+
+// XORs a row part into a display word; returns 1 if a lit pixel was turned off
+static inline uint8_t xorPixels(uint64_t& pixels, uint64_t mask)
+{
+    uint8_t collision = (pixels & mask) != 0;
+    pixels ^= mask;
+    return collision;
+}
+
+void chip8::clearDisplay()
+{
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+        if (planeMask & (1 << plane))
+            memset(display[plane], 0, sizeof(display[plane]));
+    dirtyDisplayRows = ~0ULL;
+    drawFlag = true;
+}
+
+// switching the resolution clears all planes, as in XO-CHIP
+void chip8::setResolution(bool highResolution)
+{
+    hires = highResolution;
+    memset(display, 0, sizeof(display));
+    dirtyDisplayRows = ~0ULL;
+    drawFlag = true;
+}
+
+// scrolls the selected planes by whole rows (memmove) and by pixels within a row (word shifts);
+// amounts are in pixels of the current resolution
+void chip8::scrollDisplay(int rowsDown, int pixelsRight)
+{
+    int height = getDisplayHeight();
+    size_t rowBytes = sizeof(display[0][0]);
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if ((planeMask & (1 << plane)) == 0)
+            continue;
+
+        uint64_t (*rows)[DISPLAY_ROW_WORDS] = display[plane];
+        if (rowsDown > 0)
+        {
+            memmove(rows[rowsDown], rows[0], (height - rowsDown) * rowBytes);
+            memset(rows[0], 0, rowsDown * rowBytes);
+        }
+        else if (rowsDown < 0)
+        {
+            memmove(rows[0], rows[-rowsDown], (height + rowsDown) * rowBytes);
+            memset(rows[height + rowsDown], 0, -rowsDown * rowBytes);
+        }
+
+        if (pixelsRight > 0)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                if (hires)
+                    rows[y][1] = (rows[y][1] >> pixelsRight) | (rows[y][0] << (64 - pixelsRight));
+                rows[y][0] >>= pixelsRight;
+            }
+        }
+        else if (pixelsRight < 0)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                rows[y][0] <<= -pixelsRight;
+                if (hires)
+                {
+                    rows[y][0] |= rows[y][1] >> (64 + pixelsRight);
+                    rows[y][1] <<= -pixelsRight;
+                }
+            }
+        }
+    }
+
+    dirtyDisplayRows = ~0ULL;
+    drawFlag = true;
+}
+
+// Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels,
+// or 16x16 pixels for N = 0, into every selected plane. Each plane reads its own sprite data,
+// following the previous plane's at I. The coordinates wrap around the screen; the pixels past
+// the right and bottom edges are clipped, or wrap around as well when Wrap is set.
+template <bool Wrap>
+void chip8::drawSprite(uint8_t regNumberX, uint8_t regNumberY, uint8_t height)
+{
+    int width = getDisplayWidth();
+    int displayHeight = getDisplayHeight();
+    int x = V[regNumberX] & (width - 1);
+    int y = V[regNumberY] & (displayHeight - 1);
+    bool wide = height == 0;
+    int rows = wide ? 16 : height;
+
+    V[0xF] = 0;
+    drawFlag = true;
+
+    // the sprite covers the word x / 64 of a row and the start of the next one
+    int firstWord = x / 64;
+    int secondWord = firstWord + 1;
+    if (Wrap)
+        secondWord %= width / 64;
+    bool clipRight = !Wrap && secondWord >= width / 64;
+
+    uint16_t address = I;
+    uint8_t collision = 0;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        if ((planeMask & (1 << plane)) == 0)
+            continue;
+
+        const spriteCacheEntry& sprite = getCachedSprite(address, rows, x % 64, wide);
+        address += wide ? rows * 2 : rows;
+
+        for (int yLine = 0; yLine < rows; yLine++)
+        {
+            int row = y + yLine;
+            if (Wrap)
+                row &= displayHeight - 1;
+            else if (row >= displayHeight)
+                break;
+
+            uint64_t* pixels = display[plane][row];
+            dirtyDisplayRows |= 1ULL << row;
+            collision |= xorPixels(pixels[firstWord], sprite.rows[yLine][0]);
+            if (!clipRight)
+                collision |= xorPixels(pixels[secondWord], sprite.rows[yLine][1]);
+        }
+    }
+    V[0xF] = collision;
+}
+
+// the IR draws through these
+template void chip8::drawSprite<false>(uint8_t regNumberX, uint8_t regNumberY, uint8_t height);
+template void chip8::drawSprite<true>(uint8_t regNumberX, uint8_t regNumberY, uint8_t height);
+
+// looks up the sprite rows at (address, rows, x mod 64, width), building them on a miss
+const spriteCacheEntry& chip8::getCachedSprite(uint16_t address, uint8_t height, uint8_t shift, bool wide)
+{
+    if (sprites == NULL)
+    {
+        sprites = new spriteCache();
+        memset(sprites, 0, sizeof(spriteCache));
+    }
+
+    address &= memoryMask;
+    uint16_t lastAddress = (address + (wide ? height * 2 : height) - 1) & memoryMask;
+    uint32_t version = sprites->pageVersion[address / MEMORY_PAGE_SIZE]
+        + sprites->pageVersion[lastAddress / MEMORY_PAGE_SIZE];
+
+    spriteCacheEntry& entry = sprites->entries[(address + height * 7 + wide * 3 + shift * 37) % SPRITE_CACHE_ENTRIES];
+    if (entry.address == address && entry.height == height && entry.shift == shift && entry.wide == wide
+        && entry.version == version)
+        return entry;
+
+    entry.address = address;
+    entry.height = height;
+    entry.shift = shift;
+    entry.wide = wide;
+    entry.version = version;
+    for (int yLine = 0; yLine < height; yLine++)
+    {
+        // one row of 8 or 16 pixels, leftmost pixel in the top bit
+        uint64_t pixels;
+        if (wide)
+            pixels = (uint64_t)((memory[(address + yLine * 2) & memoryMask] << 8)
+                | memory[(address + yLine * 2 + 1) & memoryMask]) << 48;
+        else
+            pixels = (uint64_t)memory[(address + yLine) & memoryMask] << 56;
+
+        entry.rows[yLine][0] = pixels >> shift;
+        entry.rows[yLine][1] = shift != 0 ? pixels << (64 - shift) : 0;
+    }
+    return entry;
+}
+
+// called after every store to emulated memory
+void chip8::onMemoryWrite(uint16_t address, uint16_t length)
+{
+    if (length == 0)
+        return;
+
+    // stores through I wrap around the end of the addressable memory
+    address &= memoryMask;
+    if (address + length > getMemorySize())
+    {
+        onMemoryWrite(0, (uint16_t)(address + length - getMemorySize()));
+        length = (uint16_t)(getMemorySize() - address);
+    }
+
+    uint32_t lastPage = ((uint32_t)address + length - 1) / MEMORY_PAGE_SIZE;
+    for (uint32_t page = address / MEMORY_PAGE_SIZE; page <= lastPage; page++)
+    {
+        dirtyPages[page / 64] |= 1ULL << (page % 64);
+        invalidatePage(page);
+    }
+}
+
+// drops what the caches derived from one memory page
+void chip8::invalidatePage(int page)
+{
+    if (ir != NULL)
+        ir->invalidatePage(page);
+    if (sprites != NULL)
+        sprites->pageVersion[page]++;
+
+    // a superinstruction reads up to 6 bytes, so the ones starting just before the page see it too
+    if (fusionKinds != NULL)
+    {
+        int first = page * MEMORY_PAGE_SIZE >= 5 ? page * MEMORY_PAGE_SIZE - 5 : 0;
+        memset(&fusionKinds[first], FUSION_UNMATCHED, (page + 1) * MEMORY_PAGE_SIZE - first);
+    }
+}
+
+// drops everything the caches derived from memory
+void chip8::invalidateCaches()
+{
+    if (ir != NULL)
+        ir->clear();
+    if (sprites != NULL)
+        for (int i = 0; i < MEMORY_PAGES; i++)
+            sprites->pageVersion[i]++;
+    if (fusionKinds != NULL)
+        memset(fusionKinds, FUSION_UNMATCHED, getMemorySize());
+}
+
+void chip8::rewindState(const chip8State& snapshot, const uint64_t* otherPages)
+{
+    uint64_t pages[(MEMORY_PAGES + 63) / 64];
+    for (int word = 0; word < (MEMORY_PAGES + 63) / 64; word++)
+    {
+        pages[word] = dirtyPages[word] | (otherPages != NULL ? otherPages[word] : 0);
+        resetPages[word] |= pages[word];
+    }
+
+    // the display is replaced as a whole
+    resetDisplayRows = ~0ULL;
+    memcpy(static_cast<chip8State*>(this), &snapshot, offsetof(chip8State, memory));
+    for (int word = 0; word < getMemoryPageWords(); word++)
+    {
+        for (uint64_t bits = pages[word]; bits != 0; bits &= bits - 1)
+        {
+            int page = word * 64 + lowestBitIndex(bits);
+
+            memcpy(&memory[page * MEMORY_PAGE_SIZE], &snapshot.memory[page * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE);
+            invalidatePage(page);
+        }
+    }
+    clearDirtyPages();
+}
+
+void chip8::clearDirtyPages()
+{
+    for (int i = 0; i < (MEMORY_PAGES + 63) / 64; i++)
+    {
+        resetPages[i] |= dirtyPages[i];
+        dirtyPages[i] = 0;
+    }
+    resetDisplayRows |= dirtyDisplayRows;
+    dirtyDisplayRows = 0;
+}
+
+void chip8::tickTimers()
+{
+    if (audio != NULL)
+        audio->renderFrame(soundTimer > 0, audioPatternLoaded ? audioPattern : NULL, pitch);
 
-    // update timers
     if (delayTimer > 0)
         delayTimer--;
 
     if (soundTimer > 0)
     {
-        if (soundTimer == 1)
-            printf("BEEP!\n");
+        if (soundTimer == 1 && logger != NULL)
+            logger->log(LOG_DEBUG, LOG_SOUND_STOPPED, this, pc, 0);
         soundTimer--;
     }
+}
+
+void chip8::setKey(uint8_t keyIndex, bool pressed)
+{
+    key[keyIndex] = pressed ? 1 : 0;
 
+    if (pressed && waitingForKey)
+    {
+        V[keyWaitRegister] = keyIndex;
+        waitingForKey = false;
+        keyReads++;
+        pc += 2;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "chip8_audio.h"
+#include <cmath>
+#include <cstring>
+
+
+audioRingBuffer::audioRingBuffer(size_t capacity)
+    : samples(capacity), mask(capacity - 1), writePosition(0), readPosition(0)
+{
+}
+
+size_t audioRingBuffer::write(const int16_t* data, size_t count)
+{
+    size_t position = writePosition.load(std::memory_order_relaxed);
+    size_t space = samples.size() - (position - readPosition.load(std::memory_order_acquire));
+    if (count > space)
+        count = space;
+
+    // at most two contiguous runs: up to the end of the buffer and from its start
+    size_t start = position & mask;
+    size_t first = count < samples.size() - start ? count : samples.size() - start;
+    memcpy(&samples[start], data, first * sizeof(int16_t));
+    memcpy(&samples[0], data + first, (count - first) * sizeof(int16_t));
+
+    writePosition.store(position + count, std::memory_order_release);
+    return count;
+}
+
+size_t audioRingBuffer::read(int16_t* data, size_t count)
+{
+    size_t position = readPosition.load(std::memory_order_relaxed);
+    size_t queued = writePosition.load(std::memory_order_acquire) - position;
+    if (count > queued)
+        count = queued;
+
+    size_t start = position & mask;
+    size_t first = count < samples.size() - start ? count : samples.size() - start;
+    memcpy(data, &samples[start], first * sizeof(int16_t));
+    memcpy(data + first, &samples[0], (count - first) * sizeof(int16_t));
+
+    readPosition.store(position + count, std::memory_order_release);
+    return count;
+}
+
+
+// buzzer: half of the pattern high, half low
+static const uint8_t squarePattern[16] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+chip8Audio::chip8Audio(uint32_t rate, size_t ringCapacity)
+    : ring(ringCapacity), sampleRate(rate), amplitude(8192), phase(0), pendingSamples(0),
+      frame(rate / AUDIO_FRAMES_PER_SECOND + 1), transfer(ringCapacity), droppedSamples(0)
+{
+}
+
+void chip8Audio::setVolume(float volume)
+{
+    if (volume < 0.0f)
+        volume = 0.0f;
+    if (volume > 1.0f)
+        volume = 1.0f;
+    amplitude = (int16_t)(volume * 32767);
+}
+
+void chip8Audio::renderFrame(bool active, const uint8_t* pattern, uint8_t pitch)
+{
+    // the frame length alternates so that frames average exactly sampleRate / 60
+    pendingSamples += (double)sampleRate / AUDIO_FRAMES_PER_SECOND;
+    size_t count = (size_t)pendingSamples;
+    pendingSamples -= count;
+    if (count > frame.size())
+        count = frame.size();
+
+    if (!active)
+    {
+        memset(frame.data(), 0, count * sizeof(int16_t));
+        phase = 0;
+    }
+    else
+    {
+        double bitsPerSecond = pattern != NULL
+            ? 4000.0 * pow(2.0, (pitch - 64) / 48.0)
+            : (double)AUDIO_TONE_FREQUENCY * 128;
+        double step = bitsPerSecond / sampleRate;
+        if (pattern == NULL)
+            pattern = squarePattern;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            int bit = (int)phase;
+            frame[i] = ((pattern[bit >> 3] >> (7 - (bit & 7))) & 1) ? amplitude : -amplitude;
+            phase += step;
+            if (phase >= 128)
+                phase -= 128 * floor(phase / 128);
+        }
+    }
+
+    size_t written = ring.write(frame.data(), count);
+    if (written < count)
+        droppedSamples.fetch_add(count - written, std::memory_order_relaxed);
+}
+
+size_t chip8Audio::pump(audioSink& sink)
+{
+    size_t total = 0;
+    size_t count;
+    while ((count = ring.read(transfer.data(), transfer.size())) > 0)
+    {
+        sink.write(transfer.data(), count);
+        total += count;
+    }
+    return total;
+}
@@ -0,0 +1,189 @@
+#include "chip8_audio_out.h"
+#include <cstring>
+#if defined(_WIN32) || defined(__CYGWIN__)
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+
+static void putLittleEndian(uint8_t* bytes, uint32_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        bytes[i] = (uint8_t)(value >> (8 * i));
+}
+
+bool wavAudioSink::open(const char* fileName, uint32_t sampleRate)
+{
+    close();
+    file = fopen(fileName, "wb");
+    if (file == NULL)
+        return false;
+
+    // RIFF header of 16-bit mono PCM; both sizes are patched by close()
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    putLittleEndian(header + 4, 36, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLittleEndian(header + 16, 16, 4);                // fmt chunk size
+    putLittleEndian(header + 20, 1, 2);                 // PCM
+    putLittleEndian(header + 22, 1, 2);                 // mono
+    putLittleEndian(header + 24, sampleRate, 4);
+    putLittleEndian(header + 28, sampleRate * 2, 4);    // bytes per second
+    putLittleEndian(header + 32, 2, 2);                 // block align
+    putLittleEndian(header + 34, 16, 2);                // bits per sample
+    memcpy(header + 36, "data", 4);
+    putLittleEndian(header + 40, 0, 4);
+    fwrite(header, 1, sizeof(header), file);
+
+    dataBytes = 0;
+    return true;
+}
+
+void wavAudioSink::write(const int16_t* samples, size_t count)
+{
+    if (file == NULL)
+        return;
+
+    // WAV is little-endian; convert in blocks so that fwrite gets large writes
+    uint8_t bytes[4096];
+    while (count > 0)
+    {
+        size_t block = count < sizeof(bytes) / 2 ? count : sizeof(bytes) / 2;
+        for (size_t i = 0; i < block; i++)
+            putLittleEndian(bytes + 2 * i, (uint16_t)samples[i], 2);
+        fwrite(bytes, 2, block, file);
+        dataBytes += (uint32_t)(block * 2);
+        samples += block;
+        count -= block;
+    }
+}
+
+void wavAudioSink::close()
+{
+    if (file == NULL)
+        return;
+
+    uint8_t size[4];
+    putLittleEndian(size, 36 + dataBytes, 4);
+    fseek(file, 4, SEEK_SET);
+    fwrite(size, 1, 4, file);
+    putLittleEndian(size, dataBytes, 4);
+    fseek(file, 40, SEEK_SET);
+    fwrite(size, 1, 4, file);
+
+    fclose(file);
+    file = NULL;
+}
+
+
+#if defined(_WIN32) || defined(__CYGWIN__)
+
+#define HOST_AUDIO_BUFFERS 4
+#define HOST_AUDIO_BUFFER_SAMPLES 1024
+
+struct hostAudioSink::device
+{
+    HWAVEOUT handle;
+    WAVEHDR headers[HOST_AUDIO_BUFFERS];
+    int16_t buffers[HOST_AUDIO_BUFFERS][HOST_AUDIO_BUFFER_SAMPLES];
+    int current;            // buffer being filled
+    size_t filled;
+};
+
+bool hostAudioSink::open(uint32_t sampleRate)
+{
+    close();
+
+    WAVEFORMATEX format;
+    memset(&format, 0, sizeof(format));
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 1;
+    format.nSamplesPerSec = sampleRate;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = 2;
+    format.nAvgBytesPerSec = sampleRate * 2;
+
+    device* d = new device();
+    memset(d, 0, sizeof(device));
+    if (waveOutOpen(&d->handle, WAVE_MAPPER, &format, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR)
+    {
+        delete d;
+        return false;
+    }
+
+    for (int i = 0; i < HOST_AUDIO_BUFFERS; i++)
+    {
+        d->headers[i].lpData = (LPSTR)d->buffers[i];
+        d->headers[i].dwBufferLength = sizeof(d->buffers[i]);
+        waveOutPrepareHeader(d->handle, &d->headers[i], sizeof(WAVEHDR));
+        d->headers[i].dwFlags |= WHDR_DONE;     // free until it is queued
+    }
+
+    impl = d;
+    return true;
+}
+
+void hostAudioSink::close()
+{
+    if (impl == NULL)
+        return;
+
+    waveOutReset(impl->handle);
+    for (int i = 0; i < HOST_AUDIO_BUFFERS; i++)
+        waveOutUnprepareHeader(impl->handle, &impl->headers[i], sizeof(WAVEHDR));
+    waveOutClose(impl->handle);
+
+    delete impl;
+    impl = NULL;
+}
+
+void hostAudioSink::write(const int16_t* samples, size_t count)
+{
+    device* d = impl;
+    if (d == NULL)
+        return;
+
+    while (count > 0)
+    {
+        WAVEHDR& header = d->headers[d->current];
+        if ((header.dwFlags & WHDR_DONE) == 0)
+            return;     // the device is still playing every buffer
+
+        size_t block = HOST_AUDIO_BUFFER_SAMPLES - d->filled;
+        if (block > count)
+            block = count;
+        memcpy(&d->buffers[d->current][d->filled], samples, block * sizeof(int16_t));
+        d->filled += block;
+        samples += block;
+        count -= block;
+
+        if (d->filled == HOST_AUDIO_BUFFER_SAMPLES)
+        {
+            header.dwFlags &= ~WHDR_DONE;
+            waveOutWrite(d->handle, &header, sizeof(WAVEHDR));
+            d->current = (d->current + 1) % HOST_AUDIO_BUFFERS;
+            d->filled = 0;
+        }
+    }
+}
+
+#else
+
+struct hostAudioSink::device
+{
+};
+
+bool hostAudioSink::open(uint32_t)
+{
+    return false;
+}
+
+void hostAudioSink::close()
+{
+}
+
+void hostAudioSink::write(const int16_t*, size_t)
+{
+}
+
+#endif
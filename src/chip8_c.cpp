@@ -0,0 +1,235 @@
+#include "chip8_c.h"
+#include "chip8.h"
+#include "chip8_env.h"
+#include <cstring>
+#include <new>
+
+#define STATE_MAGIC 0x54533843      // "C8ST"
+
+// snapshot buffers start with this header, so a state from another layout, or from a machine
+// with another quirk profile or memory size, is refused
+struct stateHeader
+{
+    uint32_t magic;
+    uint32_t abiVersion;
+    uint64_t size;
+    uint32_t quirks;
+    uint32_t memorySize;        // bytes of memory saved
+};
+
+struct chip8_machine
+{
+    chip8 machine;
+    chip8State scratch;     // aligned copy of a snapshot buffer being loaded
+
+    chip8_machine() : machine(NULL) { }
+};
+
+struct chip8_env
+{
+    chip8VectorEnv env;
+
+    chip8_env(size_t count, const envConfig& config) : env(count, config) { }
+};
+
+
+uint32_t chip8_abi_version(void)
+{
+    return CHIP8_ABI_VERSION;
+}
+
+chip8_machine* chip8_create(int quirks)
+{
+    if (quirks < 0 || quirks >= QUIRK_PROFILES_NUMBER)
+        return NULL;
+
+    chip8_machine* handle = new (std::nothrow) chip8_machine();
+    if (handle != NULL)
+        handle->machine.setQuirkProfile((quirkProfile)quirks);
+    return handle;
+}
+
+void chip8_destroy(chip8_machine* machine)
+{
+    delete machine;
+}
+
+int chip8_load(chip8_machine* machine, const uint8_t* data, size_t size)
+{
+    return machine->machine.loadROM(data, size) ? 1 : 0;
+}
+
+void chip8_seed_random(chip8_machine* machine, uint32_t seed)
+{
+    machine->machine.seedRandom(seed);
+}
+
+uint64_t chip8_run_cycles(chip8_machine* machine, uint32_t cycles)
+{
+    return machine->machine.executeInstructions(cycles);
+}
+
+uint64_t chip8_run_frames(chip8_machine* machine, uint32_t frames, uint32_t cycles_per_frame)
+{
+    uint64_t executed = 0;
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        executed += chip8_run_cycles(machine, cycles_per_frame);
+        machine->machine.tickTimers();
+    }
+    return executed;
+}
+
+void chip8_tick_timers(chip8_machine* machine)
+{
+    machine->machine.tickTimers();
+}
+
+int chip8_get_width(const chip8_machine* machine)
+{
+    return machine->machine.getDisplayWidth();
+}
+
+int chip8_get_height(const chip8_machine* machine)
+{
+    return machine->machine.getDisplayHeight();
+}
+
+const uint64_t* chip8_get_framebuffer(const chip8_machine* machine, int plane)
+{
+    if (plane < 0 || plane >= DISPLAY_PLANES)
+        return NULL;
+    return machine->machine.getDisplayRow(plane, 0);
+}
+
+int chip8_take_draw_flag(chip8_machine* machine)
+{
+    bool changed = machine->machine.drawFlag;
+    machine->machine.drawFlag = false;
+    return changed ? 1 : 0;
+}
+
+const uint8_t* chip8_get_memory(const chip8_machine* machine)
+{
+    return machine->machine.getMemory();
+}
+
+void chip8_set_key(chip8_machine* machine, int key, int pressed)
+{
+    if (key >= 0 && key < KEYS_NUMBER)
+        machine->machine.setKey((uint8_t)key, pressed != 0);
+}
+
+void chip8_set_keys(chip8_machine* machine, uint16_t mask)
+{
+    chip8& c8 = machine->machine;
+    for (int k = 0; k < KEYS_NUMBER; k++)
+    {
+        bool pressed = (mask >> k) & 1;
+        if ((c8.getState().key[k] != 0) != pressed)
+            c8.setKey((uint8_t)k, pressed);
+    }
+}
+
+int chip8_is_halted(const chip8_machine* machine)
+{
+    return machine->machine.isHalted() ? 1 : 0;
+}
+
+int chip8_is_waiting_for_key(const chip8_machine* machine)
+{
+    return machine->machine.isWaitingForKey() ? 1 : 0;
+}
+
+int chip8_is_sound_on(const chip8_machine* machine)
+{
+    return machine->machine.getState().soundTimer > 0 ? 1 : 0;
+}
+
+size_t chip8_state_size(void)
+{
+    return sizeof(stateHeader) + sizeof(chip8State);
+}
+
+void chip8_save_state(const chip8_machine* machine, void* buffer)
+{
+    const chip8& c8 = machine->machine;
+    stateHeader header = { STATE_MAGIC, CHIP8_ABI_VERSION, sizeof(chip8State), (uint32_t)c8.getQuirkProfile(),
+        (uint32_t)c8.getMemorySize() };
+    memcpy(buffer, &header, sizeof(header));
+
+    // only the profile's addressable memory is copied; the rest of the buffer is zeroed
+    size_t used = offsetof(chip8State, memory) + c8.getMemorySize();
+    memcpy((uint8_t*)buffer + sizeof(header), &c8.getState(), used);
+    memset((uint8_t*)buffer + sizeof(header) + used, 0, sizeof(chip8State) - used);
+}
+
+int chip8_load_state(chip8_machine* machine, const void* buffer)
+{
+    stateHeader header;
+    memcpy(&header, buffer, sizeof(header));
+    if (header.magic != STATE_MAGIC || header.abiVersion != CHIP8_ABI_VERSION || header.size != sizeof(chip8State))
+        return 0;
+
+    // the buffer holds only the saving machine's memory, which must be what this one addresses
+    chip8& c8 = machine->machine;
+    if (header.quirks != (uint32_t)c8.getQuirkProfile() || header.memorySize != c8.getMemorySize())
+        return 0;
+
+    memcpy(&machine->scratch, (const uint8_t*)buffer + sizeof(header), offsetof(chip8State, memory) + header.memorySize);
+    c8.loadState(machine->scratch);
+    return 1;
+}
+
+
+chip8_env* chip8_env_create(size_t count, int quirks, int observation_format, int high_resolution,
+    int cycles_per_frame, uint32_t max_episode_frames)
+{
+    if (quirks < 0 || quirks >= QUIRK_PROFILES_NUMBER || cycles_per_frame <= 0
+        || (observation_format != CHIP8_OBSERVATION_PACKED && observation_format != CHIP8_OBSERVATION_UNPACKED))
+        return NULL;
+
+    envConfig config;
+    config.quirks = (quirkProfile)quirks;
+    config.format = observation_format == CHIP8_OBSERVATION_PACKED ? OBSERVATION_PACKED : OBSERVATION_UNPACKED;
+    config.highResolution = high_resolution != 0;
+    config.cyclesPerFrame = cycles_per_frame;
+    config.maxEpisodeFrames = max_episode_frames;
+    return new (std::nothrow) chip8_env(count, config);
+}
+
+void chip8_env_destroy(chip8_env* env)
+{
+    delete env;
+}
+
+int chip8_env_load(chip8_env* env, const uint8_t* data, size_t size)
+{
+    return env->env.loadROM(data, size) ? 1 : 0;
+}
+
+void chip8_env_add_reward_probe(chip8_env* env, uint16_t address, int bytes, int bcd, int kind, float scale)
+{
+    rewardProbe probe = { address, bytes, bcd != 0, kind == CHIP8_REWARD_VALUE ? REWARD_VALUE : REWARD_DELTA, scale };
+    env->env.addRewardProbe(probe);
+}
+
+void chip8_env_set_terminal_probe(chip8_env* env, uint16_t address, uint8_t value)
+{
+    env->env.setTerminalProbe(address, value);
+}
+
+size_t chip8_env_observation_size(const chip8_env* env)
+{
+    return env->env.getObservationSize();
+}
+
+void chip8_env_reset(chip8_env* env, uint32_t seed, uint8_t* observations)
+{
+    env->env.reset(seed, observations);
+}
+
+void chip8_env_step(chip8_env* env, const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* done)
+{
+    env->env.step(actions, observations, rewards, done);
+}
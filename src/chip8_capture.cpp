@@ -0,0 +1,235 @@
+#include "chip8_capture.h"
+#include <cstring>
+
+
+// gray levels of the XO-CHIP plane combinations, as on screen
+static const uint8_t captureLevels[4] = { 0, 255, 170, 85 };
+
+// the PPM file name is used as a printf format, so it may hold nothing but literal text, %%
+// and one %u or %0Nu for the frame index
+static bool isFramePattern(const char* pattern)
+{
+    int conversions = 0;
+    for (const char* c = pattern; *c != '\0'; c++)
+    {
+        if (*c != '%')
+            continue;
+        if (*++c == '%')
+            continue;
+
+        if (*c == '0')
+        {
+            int digits = 0;
+            for (c++; *c >= '0' && *c <= '9'; c++)
+                digits++;
+            if (digits == 0 || digits > 2)
+                return false;
+        }
+        if (*c != 'u')
+            return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+chip8Capture::chip8Capture()
+    : format(CAPTURE_RAW), scale(1), width(0), height(0), stream(NULL), head(0), tail(0), queued(0),
+      stopping(false), writtenFrames(0), droppedFrames(0), failed(false)
+{
+    fileName[0] = '\0';
+}
+
+bool chip8Capture::open(const char* path, captureFormat captureFormat, int scaleFactor)
+{
+    close();
+    if (scaleFactor < 1 || scaleFactor > CAPTURE_MAX_SCALE || strlen(path) >= sizeof(fileName))
+        return false;
+    if (captureFormat == CAPTURE_PPM && !isFramePattern(path))
+        return false;
+
+    format = captureFormat;
+    scale = scaleFactor;
+    width = DISPLAY_HIRES_WIDTH * scale;
+    height = DISPLAY_HIRES_HEIGHT * scale;
+    strcpy(fileName, path);
+
+    // every buffer the writer needs is allocated here, none per frame
+    slots.resize(CAPTURE_POOL_FRAMES);
+    scaledRow.resize(width);
+    if (format == CAPTURE_Y4M)
+    {
+        // gray only: the chroma planes stay neutral and are written as they are
+        image.assign(width * height + 2 * (width / 2) * (height / 2), 128);
+    }
+    else
+        image.resize(width * height * 3);
+
+    if (format != CAPTURE_PPM)
+    {
+        stream = fopen(fileName, "wb");
+        if (stream == NULL)
+            return false;
+        streamBuffer.resize(CAPTURE_STREAM_BUFFER);
+        setvbuf(stream, streamBuffer.data(), _IOFBF, streamBuffer.size());
+
+        if (format == CAPTURE_Y4M)
+            fprintf(stream, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height);
+    }
+
+    head = tail = queued = 0;
+    stopping = false;
+    writtenFrames.store(0);
+    droppedFrames.store(0);
+    failed.store(false);
+    worker = std::thread(&chip8Capture::run, this);
+    return true;
+}
+
+void chip8Capture::close()
+{
+    if (worker.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueChanged.notify_one();
+        worker.join();
+    }
+
+    if (stream != NULL)
+    {
+        if (fclose(stream) != 0)
+            failed.store(true);
+        stream = NULL;
+    }
+}
+
+bool chip8Capture::submit(const chip8& c8)
+{
+    if (!worker.joinable())
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (queued == slots.size())
+        {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    // the head slot is not visible to the writer until queued is raised
+    frameSlot& slot = slots[head];
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+        memcpy(slot.display[plane], c8.getDisplayRow(plane, 0), sizeof(slot.display[plane]));
+    slot.hires = c8.getDisplayWidth() == DISPLAY_HIRES_WIDTH;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        head = (head + 1) % slots.size();
+        queued++;
+    }
+    queueChanged.notify_one();
+    return true;
+}
+
+void chip8Capture::run()
+{
+    uint64_t index = 0;
+    std::unique_lock<std::mutex> lock(queueMutex);
+    for (;;)
+    {
+        queueChanged.wait(lock, [this] { return queued > 0 || stopping; });
+        if (queued == 0)
+            break;  // stopping, and everything submitted is written
+
+        const frameSlot& frame = slots[tail];
+        lock.unlock();
+
+        convert(frame);
+        if (!failed.load(std::memory_order_relaxed))
+        {
+            if (writeFrame(index))
+                writtenFrames.fetch_add(1, std::memory_order_relaxed);
+            else
+                failed.store(true);
+        }
+        index++;
+
+        lock.lock();
+        tail = (tail + 1) % slots.size();
+        queued--;
+    }
+}
+
+// upscales the planes into image: gray levels for Y4M, rgb24 otherwise
+void chip8Capture::convert(const frameSlot& frame)
+{
+    int sourceWidth = frame.hires ? DISPLAY_HIRES_WIDTH : DISPLAY_LORES_WIDTH;
+    int sourceHeight = frame.hires ? DISPLAY_HIRES_HEIGHT : DISPLAY_LORES_HEIGHT;
+    int pixelSize = width / sourceWidth;
+    int bytesPerPixel = format == CAPTURE_Y4M ? 1 : 3;
+    size_t rowBytes = (size_t)width * bytesPerPixel;
+
+    for (int y = 0; y < sourceHeight; y++)
+    {
+        const uint64_t* plane0 = frame.display[0][y];
+        const uint64_t* plane1 = frame.display[1][y];
+        for (int x = 0; x < sourceWidth; x++)
+        {
+            int word = x >> 6;
+            int shift = 63 - (x & 63);
+            int color = ((plane0[word] >> shift) & 1) | (((plane1[word] >> shift) & 1) << 1);
+            memset(&scaledRow[x * pixelSize], captureLevels[color], pixelSize);
+        }
+
+        // the first output row is converted, the other pixelSize - 1 copies of it are plain copies
+        uint8_t* first = &image[(size_t)y * pixelSize * rowBytes];
+        if (bytesPerPixel == 1)
+            memcpy(first, scaledRow.data(), rowBytes);
+        else
+        {
+            for (int x = 0; x < width; x++)
+                first[3 * x] = first[3 * x + 1] = first[3 * x + 2] = scaledRow[x];
+        }
+        for (int copy = 1; copy < pixelSize; copy++)
+            memcpy(first + copy * rowBytes, first, rowBytes);
+    }
+}
+
+bool chip8Capture::writeFrame(uint64_t index)
+{
+    switch (format)
+    {
+        case CAPTURE_Y4M:
+            return fputs("FRAME\n", stream) >= 0 && fwrite(image.data(), 1, image.size(), stream) == image.size();
+        case CAPTURE_RAW:
+            return fwrite(image.data(), 1, image.size(), stream) == image.size();
+        default:
+        {
+            char name[sizeof(fileName) + 32];
+            snprintf(name, sizeof(name), fileName, (unsigned)index);
+            FILE* fp = fopen(name, "wb");
+            if (fp == NULL)
+                return false;
+            fprintf(fp, "P6\n%d %d\n255\n", width, height);
+            bool written = fwrite(image.data(), 1, image.size(), fp) == image.size();
+            return fclose(fp) == 0 && written;
+        }
+    }
+}
+
+bool parseCaptureFormat(const char* name, captureFormat& format)
+{
+    static const char* formatNames[] = { "raw", "y4m", "ppm" };
+    for (int i = 0; i < 3; i++)
+    {
+        if (strcmp(name, formatNames[i]) == 0)
+        {
+            format = (captureFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
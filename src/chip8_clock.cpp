@@ -0,0 +1,106 @@
+#include "chip8_clock.h"
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+
+static uint64_t steadyNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t realTimeClock::now()
+{
+    return steadyNow();
+}
+
+void realTimeClock::waitUntil(uint64_t deadline)
+{
+    uint64_t time = now();
+    if (time + CLOCK_SPIN_MARGIN_NS < deadline)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - CLOCK_SPIN_MARGIN_NS - time));
+    while (now() < deadline)
+        std::this_thread::yield();
+}
+
+
+framePacer::framePacer(hostClock& hostTime, uint64_t framePeriod, int catchUpLimit)
+    : clock(&hostTime), period(framePeriod), maxCatchUp(catchUpLimit), speed(1.0), step(framePeriod), maxDue(catchUpLimit),
+      frames(0), droppedFrames(0), wakeUps(0),
+      latenessSum(0), latenessSquares(0), latenessMax(0)
+{
+    startWall = steadyNow();
+    startCpu = std::clock();
+    nextDeadline = clock->now() + period;
+}
+
+void framePacer::restart()
+{
+    nextDeadline = clock->now() + step;
+}
+
+void framePacer::setSpeed(double factor)
+{
+    speed = factor > 0 ? factor : 0;
+    step = speed > 0 ? (uint64_t)(period / speed) : period;
+    if (step == 0)
+        step = 1;
+
+    // a stall at N times speed misses N times as many frames
+    maxDue = speed > 1 ? (int)(maxCatchUp * speed + 0.5) : maxCatchUp;
+    restart();
+}
+
+int framePacer::waitForFrames()
+{
+    if (speed == 0)
+    {
+        frames += CLOCK_UNCAPPED_FRAMES;
+        return CLOCK_UNCAPPED_FRAMES;
+    }
+
+    uint64_t time = clock->now();
+    if (time < nextDeadline)
+    {
+        clock->waitUntil(nextDeadline);
+        time = clock->now();
+    }
+
+    double lateness = (time - nextDeadline) / 1000.0;
+    wakeUps++;
+    latenessSum += lateness;
+    latenessSquares += lateness * lateness;
+    if (lateness > latenessMax)
+        latenessMax = lateness;
+
+    // deadlines advance by whole periods from the previous deadline, not from the wake-up time
+    uint64_t due = 1 + (time - nextDeadline) / step;
+    if (due > (uint64_t)maxDue)
+    {
+        droppedFrames += due - maxDue;
+        due = maxDue;
+        nextDeadline = time + step;
+    }
+    else
+        nextDeadline += due * step;
+
+    frames += due;
+    return (int)due;
+}
+
+pacingStats framePacer::getStats() const
+{
+    pacingStats stats;
+    stats.frames = frames;
+    stats.droppedFrames = droppedFrames;
+    stats.meanLateness = wakeUps > 0 ? latenessSum / wakeUps : 0;
+    double variance = wakeUps > 0 ? latenessSquares / wakeUps - stats.meanLateness * stats.meanLateness : 0;
+    stats.jitter = variance > 0 ? sqrt(variance) : 0;
+    stats.maxLateness = latenessMax;
+
+    // CPU use is measured against the wall clock even when the pacer runs on virtual time
+    double cpuSeconds = (double)(std::clock() - startCpu) / CLOCKS_PER_SEC;
+    double wallSeconds = (steadyNow() - startWall) / 1e9;
+    stats.cpuUsage = wallSeconds > 0 ? cpuSeconds / wallSeconds : 0;
+    return stats;
+}
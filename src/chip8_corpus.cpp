@@ -0,0 +1,129 @@
+#include "chip8_corpus.h"
+
+// Maze by David Winter: diagonal walls drawn at random until the screen is full
+static const uint8_t mazeRom[] =
+{
+    0xA2, 0x1E, 0xC2, 0x01, 0x32, 0x01, 0xA2, 0x1A, 0xD0, 0x14, 0x70, 0x04,
+    0x30, 0x40, 0x12, 0x00, 0x60, 0x00, 0x71, 0x04, 0x31, 0x20, 0x12, 0x00,
+    0x12, 0x18, 0x80, 0x40, 0x20, 0x10, 0x20, 0x40, 0x80, 0x10
+};
+
+// a ball bouncing off the walls and a paddle moved with keys 1 and 4; one move per delay timer
+// tick, the rest of the frame spins on FX07
+static const uint8_t bounceRom[] =
+{
+    0x00, 0xE0, 0x60, 0x20, 0x61, 0x10, 0x62, 0x01, 0x63, 0x01, 0x64, 0x0C,
+    0x65, 0x02, 0xA2, 0x72, 0xD5, 0x46, 0xA2, 0x78, 0xD0, 0x11, 0xA2, 0x78,
+    0xD0, 0x11, 0x80, 0x24, 0x81, 0x34, 0x30, 0x3F, 0x12, 0x24, 0x62, 0xFF,
+    0x30, 0x00, 0x12, 0x2A, 0x62, 0x01, 0x31, 0x1F, 0x12, 0x30, 0x63, 0xFF,
+    0x31, 0x00, 0x12, 0x36, 0x63, 0x01, 0xD0, 0x11, 0x3F, 0x00, 0x12, 0x3E,
+    0x12, 0x46, 0xD0, 0x11, 0x62, 0x01, 0x80, 0x24, 0xD0, 0x11, 0x66, 0x01,
+    0xE6, 0xA1, 0x12, 0x54, 0x66, 0x04, 0xE6, 0xA1, 0x12, 0x5E, 0x12, 0x66,
+    0xA2, 0x72, 0xD5, 0x46, 0x74, 0xFF, 0xD5, 0x46, 0x12, 0x66, 0xA2, 0x72,
+    0xD5, 0x46, 0x74, 0x01, 0xD5, 0x46, 0xF7, 0x07, 0x37, 0x00, 0x12, 0x66,
+    0x67, 0x01, 0xF7, 0x15, 0x12, 0x16, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80
+};
+
+// bubble sort of 64 random bytes at 0x400 through FX55/FX65 and 8XY5, then the round count in
+// BCD on the screen; relies on FX55/FX65 leaving I unchanged
+static const uint8_t sortRom[] =
+{
+    0x62, 0x01, 0xA4, 0x00, 0x64, 0x40, 0xC0, 0xFF, 0xF0, 0x55, 0xF2, 0x1E,
+    0x74, 0xFF, 0x34, 0x00, 0x12, 0x06, 0x65, 0x00, 0xA4, 0x00, 0x64, 0x3F,
+    0xF1, 0x65, 0x83, 0x10, 0x83, 0x05, 0x3F, 0x00, 0x12, 0x2C, 0x83, 0x00,
+    0x80, 0x10, 0x81, 0x30, 0xF1, 0x55, 0x65, 0x01, 0xF2, 0x1E, 0x74, 0xFF,
+    0x34, 0x00, 0x12, 0x18, 0x35, 0x00, 0x12, 0x12, 0x76, 0x01, 0xA5, 0x00,
+    0xF6, 0x33, 0xF2, 0x65, 0x00, 0xE0, 0x67, 0x00, 0x68, 0x00, 0xF0, 0x29,
+    0xD7, 0x85, 0x67, 0x05, 0xF1, 0x29, 0xD7, 0x85, 0x67, 0x0A, 0xF2, 0x29,
+    0xD7, 0x85, 0x12, 0x00
+};
+
+// SUPER-CHIP high resolution: 16x16 sprites (DXY0) at random places between scrolls down,
+// right and left, and a clear every 64 sprites
+static const uint8_t scrollRom[] =
+{
+    0x00, 0xFF, 0x62, 0x00, 0xC0, 0x7F, 0xC1, 0x3F, 0xA2, 0x3A, 0xD0, 0x10,
+    0x72, 0x01, 0x83, 0x20, 0x64, 0x03, 0x83, 0x42, 0x33, 0x00, 0x12, 0x1C,
+    0x00, 0xC4, 0x12, 0x04, 0x33, 0x01, 0x12, 0x24, 0x00, 0xFB, 0x12, 0x04,
+    0x33, 0x02, 0x12, 0x2C, 0x00, 0xFC, 0x12, 0x04, 0x83, 0x20, 0x64, 0x3F,
+    0x83, 0x42, 0x33, 0x3F, 0x12, 0x04, 0x00, 0xE0, 0x12, 0x04, 0x07, 0xE0,
+    0x18, 0x18, 0x20, 0x04, 0x40, 0x02, 0x4C, 0x32, 0x8C, 0x31, 0x80, 0x01,
+    0x80, 0x01, 0x90, 0x09, 0x88, 0x11, 0x47, 0xE2, 0x40, 0x02, 0x20, 0x04,
+    0x18, 0x18, 0x07, 0xE0, 0x00, 0x00
+};
+
+// waits for a key (FX0A) and prints its digit, in rows across the screen
+static const uint8_t keypadRom[] =
+{
+    0x00, 0xE0, 0x65, 0x00, 0x66, 0x00, 0xF0, 0x0A, 0xF0, 0x29, 0xD5, 0x65,
+    0x75, 0x05, 0x35, 0x3C, 0x12, 0x06, 0x65, 0x00, 0x76, 0x06, 0x36, 0x1E,
+    0x12, 0x06, 0x66, 0x00, 0x00, 0xE0, 0x12, 0x06
+};
+
+// paddle up for half a second, then down
+static const corpusInput bounceInputs[] =
+{
+    { 20, 0x0002 }, { 50, 0x0000 }, { 70, 0x0010 }, { 100, 0x0000 }
+};
+
+// keys 0 to F in turn, each held for two frames
+static const corpusInput keypadInputs[] =
+{
+    { 0, 0x0001 }, { 2, 0 }, { 4, 0x0002 }, { 6, 0 }, { 8, 0x0004 }, { 10, 0 }, { 12, 0x0008 }, { 14, 0 },
+    { 16, 0x0010 }, { 18, 0 }, { 20, 0x0020 }, { 22, 0 }, { 24, 0x0040 }, { 26, 0 }, { 28, 0x0080 }, { 30, 0 },
+    { 32, 0x0100 }, { 34, 0 }, { 36, 0x0200 }, { 38, 0 }, { 40, 0x0400 }, { 42, 0 }, { 44, 0x0800 }, { 46, 0 },
+    { 48, 0x1000 }, { 50, 0 }, { 52, 0x2000 }, { 54, 0 }, { 56, 0x4000 }, { 58, 0 }, { 60, 0x8000 }, { 62, 0 }
+};
+
+const corpusRom corpusRoms[CORPUS_ROMS_NUMBER] =
+{
+    { "maze", "David Winter, public domain", QUIRKS_COSMAC_VIP, mazeRom, sizeof(mazeRom), 9, 600, NULL, 0, 0 },
+    { "bounce", "written for the benchmarks, public domain", QUIRKS_MODERN, bounceRom, sizeof(bounceRom), 12, 3600,
+        bounceInputs, sizeof(bounceInputs) / sizeof(bounceInputs[0]), 120 },
+    { "sort", "written for the benchmarks, public domain", QUIRKS_SUPER_CHIP, sortRom, sizeof(sortRom), 500, 600, NULL, 0, 0 },
+    { "scroll", "written for the benchmarks, public domain", QUIRKS_SUPER_CHIP, scrollRom, sizeof(scrollRom), 30, 1800, NULL, 0, 0 },
+    { "keypad", "written for the benchmarks, public domain", QUIRKS_MODERN, keypadRom, sizeof(keypadRom), 12, 1280,
+        keypadInputs, sizeof(keypadInputs) / sizeof(keypadInputs[0]), 64 }
+};
+
+uint64_t playCorpusRom(chip8& c8, const corpusRom& rom, bool useIR)
+{
+    c8.setQuirkProfile(rom.quirks);
+    if (!c8.loadROM(rom.data, rom.size))
+        return 0;
+    c8.seedRandom(CORPUS_SEED);
+
+    uint64_t startInstructions = c8.getExecutedInstructions();
+    size_t nextInput = 0;
+    uint16_t held = 0;
+    for (uint32_t frame = 0; frame < rom.frames; frame++)
+    {
+        uint32_t time = rom.inputPeriod > 0 ? frame % rom.inputPeriod : frame;
+        if (time == 0)
+        {
+            nextInput = 0;
+            held = 0;
+        }
+        while (nextInput < rom.inputsNumber && rom.inputs[nextInput].frame <= time)
+            held = rom.inputs[nextInput++].keys;
+
+        // transitions only, like a frontend
+        const uint8_t* keys = c8.getState().key;
+        for (int k = 0; k < KEYS_NUMBER; k++)
+        {
+            bool pressed = (held >> k) & 1;
+            if ((keys[k] != 0) != pressed)
+                c8.setKey((uint8_t)k, pressed);
+        }
+
+        uint64_t target = c8.getExecutedInstructions() + rom.cyclesPerFrame;
+        if (useIR)
+            while (c8.getExecutedInstructions() < target && !c8.isHalted() && !c8.isWaitingForKey())
+                c8.executeBlock();
+        else
+            c8.executeInstructions(rom.cyclesPerFrame);
+        c8.tickTimers();
+    }
+    return c8.getExecutedInstructions() - startInstructions;
+}
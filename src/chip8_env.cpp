@@ -0,0 +1,192 @@
+#include "chip8_env.h"
+#include <cstring>
+
+
+// entry b: eight bytes in memory order, byte i is bit 7 - i of b
+static const struct bitSpreadTable
+{
+    uint64_t entries[256];
+
+    bitSpreadTable()
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            uint8_t bytes[8];
+            for (int i = 0; i < 8; i++)
+                bytes[i] = (b >> (7 - i)) & 1;
+            memcpy(&entries[b], bytes, 8);
+        }
+    }
+} spreadTable;
+
+
+chip8VectorEnv::chip8VectorEnv(size_t count, const envConfig& settings)
+    : config(settings), pool(settings.logger), romId(-1), instances(count, NULL), episodeFrames(count, 0), episodes(count, 0), baseSeed(1)
+{
+}
+
+chip8VectorEnv::~chip8VectorEnv()
+{
+    // the pool deletes the instances
+}
+
+bool chip8VectorEnv::loadROM(const uint8_t* data, size_t size)
+{
+    int newRomId = pool.addRom(data, size, config.quirks);
+    if (newRomId < 0)
+        return false;
+
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        if (instances[i] != NULL)
+            pool.release(instances[i]);
+        instances[i] = pool.acquire(newRomId, 1);
+    }
+    romId = newRomId;
+    return true;
+}
+
+uint32_t chip8VectorEnv::readProbe(const chip8& c8, const rewardProbe& probe) const
+{
+    const uint8_t* memory = c8.getMemory();
+    uint32_t value = 0;
+    for (int i = 0; i < probe.bytes && i < 4; i++)
+        value = value * (probe.bcd ? 10 : 256) + memory[(probe.address + i) % c8.getMemorySize()];
+    return value;
+}
+
+void chip8VectorEnv::startEpisode(size_t index)
+{
+    // a distinct CXNN sequence for every instance and episode, reproducible from the reset seed
+    uint32_t seed = baseSeed + 0x9E3779B9u * (uint32_t)(index + 1) + 0x85EBCA6Bu * episodes[index];
+    pool.reset(instances[index], seed);
+    episodes[index]++;
+    episodeFrames[index] = 0;
+
+    for (size_t p = 0; p < probes.size(); p++)
+        probeValues[index * probes.size() + p] = readProbe(*instances[index], probes[p]);
+}
+
+void chip8VectorEnv::reset(uint32_t seed, uint8_t* observations)
+{
+    if (romId < 0)
+        return;
+
+    baseSeed = seed;
+    probeValues.assign(instances.size() * probes.size(), 0);
+    size_t observationSize = getObservationSize();
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        episodes[i] = 0;
+        startEpisode(i);
+        if (observations != NULL)
+            writeObservation(*instances[i], observations + i * observationSize);
+    }
+}
+
+size_t chip8VectorEnv::getObservationSize() const
+{
+    size_t pixels = (size_t)getObservationWidth() * getObservationHeight();
+    return config.format == OBSERVATION_PACKED ? pixels / 8 : pixels;
+}
+
+void chip8VectorEnv::writeObservation(const chip8& c8, uint8_t* observation) const
+{
+    int width = getObservationWidth();
+    int height = getObservationHeight();
+    bool frameHires = c8.getDisplayWidth() == DISPLAY_HIRES_WIDTH;
+
+    if (frameHires == config.highResolution)
+    {
+        // same resolution: whole display words at a time
+        for (int y = 0; y < height; y++)
+        {
+            const uint64_t* plane0 = c8.getDisplayRow(0, y);
+            const uint64_t* plane1 = c8.getDisplayRow(1, y);
+            for (int word = 0; word < width / 64; word++)
+            {
+                if (config.format == OBSERVATION_PACKED)
+                {
+                    uint64_t lit = plane0[word] | plane1[word];
+                    for (int byte = 0; byte < 8; byte++)
+                        *observation++ = (uint8_t)(lit >> (56 - 8 * byte));
+                }
+                else
+                {
+                    // eight pixels per table lookup; each byte of an entry is 0 or 1, so a shift
+                    // moves plane 1 into bit 1 without carrying into the neighbour
+                    for (int byte = 0; byte < 8; byte++)
+                    {
+                        uint64_t colors = spreadTable.entries[(plane0[word] >> (56 - 8 * byte)) & 0xFF]
+                            | (spreadTable.entries[(plane1[word] >> (56 - 8 * byte)) & 0xFF] << 1);
+                        memcpy(observation, &colors, 8);
+                        observation += 8;
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    // the other resolution: low-resolution pixels doubled, or high-resolution ones sampled
+    if (config.format == OBSERVATION_PACKED)
+        memset(observation, 0, getObservationSize());
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t color = frameHires ? c8.getPixel(x * 2, y * 2) : c8.getPixel(x / 2, y / 2);
+            if (config.format == OBSERVATION_PACKED)
+                observation[(y * width + x) / 8] |= (color != 0) << (7 - x % 8);
+            else
+                observation[y * width + x] = color;
+        }
+}
+
+void chip8VectorEnv::step(const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* done)
+{
+    if (romId < 0)
+        return;
+
+    size_t observationSize = getObservationSize();
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        chip8& c8 = *instances[i];
+
+        const uint8_t* held = c8.getState().key;
+        for (int k = 0; k < KEYS_NUMBER; k++)
+        {
+            bool pressed = (actions[i] >> k) & 1;
+            if ((held[k] != 0) != pressed)
+                c8.setKey((uint8_t)k, pressed);
+        }
+
+        c8.executeInstructions(config.cyclesPerFrame);
+        c8.tickTimers();
+        episodeFrames[i]++;
+
+        float reward = 0;
+        uint32_t* values = probeValues.data() + i * probes.size();
+        for (size_t p = 0; p < probes.size(); p++)
+        {
+            uint32_t value = readProbe(c8, probes[p]);
+            if (probes[p].kind == REWARD_DELTA)
+                reward += probes[p].scale * (float)((int64_t)value - (int64_t)values[p]);
+            else
+                reward += probes[p].scale * (float)value;
+            values[p] = value;
+        }
+
+        bool finished = c8.isHalted()
+            || (config.terminalAddress >= 0 && c8.getMemory()[config.terminalAddress % c8.getMemorySize()] == config.terminalValue)
+            || (config.maxEpisodeFrames > 0 && episodeFrames[i] >= config.maxEpisodeFrames);
+        if (finished)
+            startEpisode(i);
+
+        if (rewards != NULL)
+            rewards[i] = reward;
+        if (done != NULL)
+            done[i] = finished;
+        if (observations != NULL)
+            writeObservation(c8, observations + i * observationSize);
+    }
+}
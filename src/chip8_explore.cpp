@@ -0,0 +1,390 @@
+#include "chip8_explore.h"
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// a stored node: the state up to memory, the cycle within the frame, then the pages that differ
+// from the start state as indices followed by contents
+#define NODE_HEADER_SIZE offsetof(chip8State, memory)
+#define NODE_PAGES_OFFSET (NODE_HEADER_SIZE + 2 * sizeof(uint32_t))
+#define PAGE_WORDS ((MEMORY_PAGES + 63) / 64)
+
+enum pollKind { POLL_NONE, POLL_KEY_SKIP, POLL_KEY_WAIT };
+
+static pollKind pollAt(const chip8State& state, uint16_t memoryMask)
+{
+    uint16_t opcode = (state.memory[state.pc & memoryMask] << 8) | state.memory[(state.pc + 1) & memoryMask];
+    // decoded like the interpreter: EX9E and EXA1 by their third nibble
+    if ((opcode & 0xF0F0) == 0xE090 || (opcode & 0xF0F0) == 0xE0A0)
+        return POLL_KEY_SKIP;
+    if ((opcode & 0xF0FF) == 0xF00A)
+        return POLL_KEY_WAIT;
+    return POLL_NONE;
+}
+
+// 64-bit multiply-xorshift over 8-byte words
+static uint64_t mix(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (; size >= 8; size -= 8, bytes += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    for (; size > 0; size--, bytes++)
+    {
+        hash = (hash ^ *bytes) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+
+concurrentHashSet::concurrentHashSet(size_t capacity)
+    : count(0)
+{
+    size_t size = 64;
+    while (size < capacity)
+        size *= 2;
+    slots = std::vector<std::atomic<uint64_t>>(size);
+    mask = size - 1;
+    limit = size / 4 * 3;
+    clear();
+}
+
+void concurrentHashSet::clear()
+{
+    for (size_t i = 0; i < slots.size(); i++)
+        slots[i].store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+}
+
+bool concurrentHashSet::insert(uint64_t hash)
+{
+    if (hash == 0)
+        hash = 1;
+    if (isFull())
+        return false;
+
+    for (size_t i = (hash ^ (hash >> 32)) & mask; ; i = (i + 1) & mask)
+    {
+        uint64_t seen = slots[i].load(std::memory_order_relaxed);
+        if (seen == 0)
+        {
+            if (slots[i].compare_exchange_strong(seen, hash, std::memory_order_relaxed))
+            {
+                count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            // another thread took the slot; it may have stored this very hash
+        }
+        if (seen == hash)
+            return false;
+    }
+}
+
+
+struct stateExplorer::worker
+{
+    chip8 machine;
+    std::vector<chip8State> node;           // one element: the node being expanded
+    std::vector<uint16_t> nodePages;        // pages of node that differ from the start memory
+    std::vector<uint16_t> childPages;
+    std::vector<uint8_t> children[2];       // encoded nodes of the level being built, double-buffered
+    std::vector<size_t> childOffsets;
+    int current;
+    std::vector<uint64_t> coveredPcs;
+    uint64_t litPixels[DISPLAY_HIRES_HEIGHT][DISPLAY_ROW_WORDS];
+    uint64_t duplicates, halted, truncated, branchesRun, instructions;
+
+    worker() : node(1), current(0), coveredPcs(MEMORY_SIZE / 64, 0),
+        duplicates(0), halted(0), truncated(0), branchesRun(0), instructions(0)
+    {
+        memset(litPixels, 0, sizeof(litPixels));
+    }
+};
+
+
+stateExplorer::stateExplorer(const exploreOptions& exploreSettings)
+    : options(exploreSettings), start(1), quirks(QUIRKS_MODERN), memoryMask(MEMORY_MASK), states(exploreSettings.maxStates + exploreSettings.maxStates / 3),
+      frames(exploreSettings.maxStates + exploreSettings.maxStates / 3), coveredPcs(MEMORY_SIZE / 64, 0), nextLevelSize(0)
+{
+    memset(litPixels, 0, sizeof(litPixels));
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint64_t stateExplorer::hashNode(const chip8State& state, int cycle, const std::vector<uint16_t>& pages)
+{
+    // what decides the future of the machine; counters, dirty bits and the key array are left out,
+    // every branch releases its key again
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    hash = mix(hash, &state.pc, sizeof(state.pc));
+    hash = mix(hash, &state.I, sizeof(state.I));
+    hash = mix(hash, state.V, sizeof(state.V));
+    hash = mix(hash, &state.stackLevel, sizeof(state.stackLevel));
+    hash = mix(hash, state.stack, sizeof(state.stack));
+    hash = mix(hash, &state.delayTimer, sizeof(state.delayTimer));
+    hash = mix(hash, &state.soundTimer, sizeof(state.soundTimer));
+    hash = mix(hash, &state.hires, sizeof(state.hires));
+    hash = mix(hash, &state.planeMask, sizeof(state.planeMask));
+    hash = mix(hash, &state.randomState, sizeof(state.randomState));
+    hash = mix(hash, state.rplFlags, sizeof(state.rplFlags));
+    hash = mix(hash, state.audioPattern, sizeof(state.audioPattern));
+    hash = mix(hash, &state.pitch, sizeof(state.pitch));
+    hash = mix(hash, &cycle, sizeof(cycle));
+    hash = mix(hash, state.display, sizeof(state.display));
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        hash = mix(hash, &pages[i], sizeof(pages[i]));
+        hash = mix(hash, state.memory + pages[i] * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+    }
+    return hash;
+}
+
+uint64_t stateExplorer::hashDisplay(const chip8State& state)
+{
+    return mix(state.hires, state.display, sizeof(state.display));
+}
+
+// runs one branch from the node in w.node: the poll with the key pressed, then up to the next poll
+void stateExplorer::runBranch(worker& w, int branchKey, int cycle, const std::vector<uint16_t>& parentPages)
+{
+    // the machine holds the node plus what the previous branch changed
+    chip8& c8 = w.machine;
+    c8.rewindState(w.node[0]);
+    w.branchesRun++;
+
+    const chip8State& state = c8.getState();
+    bool wait = pollAt(state, memoryMask) == POLL_KEY_WAIT;
+    int frameCount = 0;
+    for (bool first = true; ; first = false)
+    {
+        if (state.halted)
+        {
+            w.halted++;
+            return;
+        }
+        if (cycle == options.cyclesPerFrame)
+        {
+            c8.tickTimers();
+            cycle = 0;
+            if (++frameCount >= options.segmentFrames)
+                break;
+        }
+        if (!first && pollAt(state, memoryMask) != POLL_NONE)
+            break;
+
+        uint16_t pc = state.pc;
+        uint64_t executed = c8.getExecutedInstructions();
+        if (first && branchKey != EXPLORE_KEY_NONE && !wait)
+            c8.setKey((uint8_t)branchKey, true);
+        c8.executeCycle(std::min(options.cyclesPerFrame - cycle, FUSED_MAX_INSTRUCTIONS));
+        if (first && branchKey != EXPLORE_KEY_NONE)
+        {
+            // FX0A is released by the press; EX9E/EXA1 only needed the key for this instruction
+            if (wait)
+                c8.setKey((uint8_t)branchKey, true);
+            c8.setKey((uint8_t)branchKey, false);
+        }
+
+        // superinstructions are straight-line, so their opcodes follow each other
+        executed = c8.getExecutedInstructions() - executed;
+        cycle += (int)executed;
+        w.instructions += executed;
+        for (uint64_t i = 0; i < executed; i++)
+        {
+            uint16_t address = (pc + 2 * i) & memoryMask;
+            w.coveredPcs[address / 64] |= 1ULL << (address % 64);
+        }
+    }
+
+    for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++)
+        for (int word = 0; word < DISPLAY_ROW_WORDS; word++)
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+                w.litPixels[y][word] |= state.display[plane][y][word];
+
+    // pages now different from the start: the parent's plus those written by this branch,
+    // minus any written back to their start contents
+    uint64_t candidates[PAGE_WORDS];
+    memcpy(candidates, c8.getDirtyPages(), sizeof(candidates));
+    for (size_t i = 0; i < parentPages.size(); i++)
+        candidates[parentPages[i] / 64] |= 1ULL << (parentPages[i] % 64);
+    w.childPages.clear();
+    for (int word = 0; word < PAGE_WORDS; word++)
+        for (uint64_t bits = candidates[word]; bits != 0; bits &= bits - 1)
+        {
+            int page = word * 64 + __builtin_ctzll(bits);
+            if (memcmp(state.memory + page * MEMORY_PAGE_SIZE, start[0].memory + page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE) != 0)
+                w.childPages.push_back((uint16_t)page);
+        }
+
+    if (states.isFull())
+    {
+        w.truncated++;
+        return;
+    }
+    if (!states.insert(hashNode(state, cycle, w.childPages)))
+    {
+        w.duplicates++;
+        return;
+    }
+    frames.insert(hashDisplay(state));
+    if (nextLevelSize.fetch_add(1, std::memory_order_relaxed) >= options.maxFrontier)
+    {
+        w.truncated++;
+        return;
+    }
+
+    std::vector<uint8_t>& arena = w.children[w.current];
+    size_t offset = arena.size();
+    arena.resize(offset + NODE_PAGES_OFFSET + w.childPages.size() * (sizeof(uint16_t) + MEMORY_PAGE_SIZE));
+    uint8_t* node = arena.data() + offset;
+    uint32_t header[2] = { (uint32_t)cycle, (uint32_t)w.childPages.size() };
+    memcpy(node, &state, NODE_HEADER_SIZE);
+    memcpy(node + NODE_HEADER_SIZE, header, sizeof(header));
+    uint8_t* pages = node + NODE_PAGES_OFFSET;
+    memcpy(pages, w.childPages.data(), w.childPages.size() * sizeof(uint16_t));
+    pages += w.childPages.size() * sizeof(uint16_t);
+    for (size_t i = 0; i < w.childPages.size(); i++)
+        memcpy(pages + i * MEMORY_PAGE_SIZE, state.memory + w.childPages[i] * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+    w.childOffsets.push_back(offset);
+}
+
+void stateExplorer::expandNode(worker& w, const uint8_t* node)
+{
+    // rebuild the full state: put back the start contents of the previous node's pages, then
+    // copy in this node's; the machine is then moved over by the pages of both
+    chip8State& state = w.node[0];
+    uint64_t changed[PAGE_WORDS] = { 0 };
+    for (size_t i = 0; i < w.nodePages.size(); i++)
+    {
+        memcpy(state.memory + w.nodePages[i] * MEMORY_PAGE_SIZE, start[0].memory + w.nodePages[i] * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        changed[w.nodePages[i] / 64] |= 1ULL << (w.nodePages[i] % 64);
+    }
+
+    uint32_t header[2];
+    memcpy(&state, node, NODE_HEADER_SIZE);
+    memcpy(header, node + NODE_HEADER_SIZE, sizeof(header));
+    w.nodePages.resize(header[1]);
+    memcpy(w.nodePages.data(), node + NODE_PAGES_OFFSET, header[1] * sizeof(uint16_t));
+    const uint8_t* pages = node + NODE_PAGES_OFFSET + header[1] * sizeof(uint16_t);
+    for (uint32_t i = 0; i < header[1]; i++)
+    {
+        memcpy(state.memory + w.nodePages[i] * MEMORY_PAGE_SIZE, pages + i * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        changed[w.nodePages[i] / 64] |= 1ULL << (w.nodePages[i] % 64);
+    }
+    w.machine.rewindState(state, changed);
+
+    int cycle = (int)header[0];
+    switch (pollAt(state, memoryMask))
+    {
+        case POLL_KEY_SKIP:
+        {
+            // only the key in VX is read: every other key gives the no-key branch
+            runBranch(w, state.V[(state.memory[state.pc & memoryMask] & 0x0F)] & 0x0F, cycle, w.nodePages);
+            runBranch(w, EXPLORE_KEY_NONE, cycle, w.nodePages);
+            w.duplicates += KEYS_NUMBER - 1;
+            break;
+        }
+        case POLL_KEY_WAIT:
+            for (int k = 0; k < KEYS_NUMBER; k++)
+                runBranch(w, k, cycle, w.nodePages);
+            break;
+        default:
+            // cut by the segment limit, or the start state
+            runBranch(w, EXPLORE_KEY_NONE, cycle, w.nodePages);
+    }
+}
+
+bool stateExplorer::explore(const chip8& machine)
+{
+    if (options.cyclesPerFrame <= 0 || options.segmentFrames <= 0 || options.maxFrontier == 0)
+        return false;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    machine.saveState(start[0]);
+    quirks = machine.getQuirkProfile();
+    memoryMask = (uint16_t)(machine.getMemorySize() - 1);
+    memset(&stats, 0, sizeof(stats));
+    memset(litPixels, 0, sizeof(litPixels));
+    states.clear();
+    frames.clear();
+    std::fill(coveredPcs.begin(), coveredPcs.end(), 0);
+
+    unsigned threadsNumber = options.threads > 0 ? options.threads : 1;
+    std::vector<worker*> workers;
+    for (unsigned t = 0; t < threadsNumber; t++)
+    {
+        worker* w = new worker();
+        w->machine.setQuirkProfile(quirks);
+        w->machine.loadState(start[0]);
+        w->machine.clearDirtyPages();
+        w->node[0] = start[0];
+        workers.push_back(w);
+    }
+
+    // the start state is the only node of level 0, whether or not it is at a poll
+    std::vector<uint8_t> root(NODE_PAGES_OFFSET);
+    uint32_t header[2] = { 0, 0 };
+    memcpy(root.data(), &start[0], NODE_HEADER_SIZE);
+    memcpy(root.data() + NODE_HEADER_SIZE, header, sizeof(header));
+    states.insert(hashNode(start[0], 0, std::vector<uint16_t>()));
+    frames.insert(hashDisplay(start[0]));
+
+    std::vector<const uint8_t*> frontier(1, root.data());
+    while (!frontier.empty() && (options.maxDepth == 0 || stats.levels < options.maxDepth))
+    {
+        std::atomic<size_t> nextNode(0);
+        nextLevelSize.store(0, std::memory_order_relaxed);
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < threadsNumber; t++)
+            threads.push_back(std::thread([&, t]
+            {
+                worker& w = *workers[t];
+                w.current ^= 1;
+                w.children[w.current].clear();
+                w.childOffsets.clear();
+                for (size_t i; (i = nextNode.fetch_add(1, std::memory_order_relaxed)) < frontier.size(); )
+                    expandNode(w, frontier[i]);
+            }));
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+
+        // the arenas are complete now, so their nodes no longer move
+        frontier.clear();
+        for (unsigned t = 0; t < threadsNumber; t++)
+            for (size_t i = 0; i < workers[t]->childOffsets.size(); i++)
+                frontier.push_back(workers[t]->children[workers[t]->current].data() + workers[t]->childOffsets[i]);
+        stats.levels++;
+    }
+
+    for (unsigned t = 0; t < threadsNumber; t++)
+    {
+        worker& w = *workers[t];
+        for (size_t i = 0; i < coveredPcs.size(); i++)
+            coveredPcs[i] |= w.coveredPcs[i];
+        for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++)
+            for (int word = 0; word < DISPLAY_ROW_WORDS; word++)
+                litPixels[y][word] |= w.litPixels[y][word];
+        stats.duplicates += w.duplicates;
+        stats.halted += w.halted;
+        stats.truncated += w.truncated;
+        stats.branchesRun += w.branchesRun;
+        stats.instructions += w.instructions;
+        delete workers[t];
+    }
+
+    stats.states = states.size();
+    stats.distinctFrames = frames.size();
+    for (size_t i = 0; i < coveredPcs.size(); i++)
+        stats.coveredAddresses += 2 * __builtin_popcountll(coveredPcs[i]);
+    for (int y = 0; y < DISPLAY_HIRES_HEIGHT; y++)
+        for (int word = 0; word < DISPLAY_ROW_WORDS; word++)
+            stats.litPixels += __builtin_popcountll(litPixels[y][word]);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return true;
+}
@@ -0,0 +1,105 @@
+#include "chip8_input.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+void keyMap::setDefault()
+{
+    static const char* hostKeys = "1234qwerasdfzxcv";
+    static const uint8_t chip8Keys[16] = { 0x1, 0x2, 0x3, 0xC, 0x4, 0x5, 0x6, 0xD, 0x7, 0x8, 0x9, 0xE, 0xA, 0x0, 0xB, 0xF };
+
+    memset(keys, -1, sizeof(keys));
+    for (int i = 0; i < 16; i++)
+        keys[(unsigned char)hostKeys[i]] = chip8Keys[i];
+}
+
+bool keyMap::load(const char* fileName)
+{
+    FILE* fp = fopen(fileName, "r");
+    if (fp == NULL)
+        return false;
+
+    memset(keys, -1, sizeof(keys));
+    char line[128];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        // '#' as a host key is written 0x23
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char hostKey[16];
+        unsigned key;
+        if (sscanf(line, "%15s %x", hostKey, &key) != 2 || key >= KEYS_NUMBER)
+            continue;
+
+        if (strlen(hostKey) == 1)
+            keys[(unsigned char)hostKey[0]] = (int8_t)key;
+        else if (strncmp(hostKey, "0x", 2) == 0 && strtoul(hostKey, NULL, 16) < 256)
+            keys[strtoul(hostKey, NULL, 16)] = (int8_t)key;
+    }
+    fclose(fp);
+    return true;
+}
+
+
+inputQueue::inputQueue(size_t capacity)
+    : events(capacity), mask(capacity - 1), writePosition(0), readPosition(0), dropped(0)
+{
+    for (int k = 0; k < KEYS_NUMBER; k++)
+    {
+        pressPending[k] = false;
+        pressKeyReads[k] = 0;
+        pressInstructions[k] = 0;
+    }
+}
+
+bool inputQueue::push(uint64_t time, uint8_t key, bool pressed)
+{
+    size_t position = writePosition.load(std::memory_order_relaxed);
+    if (position - readPosition.load(std::memory_order_acquire) == events.size())
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    inputEvent& event = events[position & mask];
+    event.time = time;
+    event.key = key;
+    event.pressed = pressed;
+    writePosition.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// a release of a key whose press no EX9E, EXA1 or FX0A has read yet waits, unless the CPU cannot
+// run to read it (halted or waiting in FX0A) or it has waited INPUT_MAX_HOLD_INSTRUCTIONS already
+bool inputQueue::isReleaseHeld(const chip8& c8, uint8_t key) const
+{
+    return pressPending[key] && c8.getKeyReads() == pressKeyReads[key]
+        && c8.getExecutedInstructions() - pressInstructions[key] < INPUT_MAX_HOLD_INSTRUCTIONS
+        && !c8.isHalted() && !c8.isWaitingForKey();
+}
+
+size_t inputQueue::apply(chip8& c8, uint64_t upTo)
+{
+    size_t position = readPosition.load(std::memory_order_relaxed);
+    size_t end = writePosition.load(std::memory_order_acquire);
+    size_t applied = 0;
+    for (; position != end && events[position & mask].time <= upTo; position++, applied++)
+    {
+        const inputEvent& event = events[position & mask];
+        uint8_t key = event.key & (KEYS_NUMBER - 1);
+        if (!event.pressed && isReleaseHeld(c8, key))
+            break;
+
+        // taken before setKey(), which counts the read when the press completes an FX0A
+        pressPending[key] = event.pressed;
+        pressKeyReads[key] = c8.getKeyReads();
+        pressInstructions[key] = c8.getExecutedInstructions();
+        c8.setKey(key, event.pressed);
+    }
+
+    readPosition.store(position, std::memory_order_release);
+    return applied;
+}
@@ -0,0 +1,648 @@
+#include "chip8_ir.h"
+#include "chip8.h"
+
+#define VF_BIT (1 << 0xF)
+
+
+static bool isTerminator(uint8_t kind)
+{
+    return kind >= UOP_CONTINUE;
+}
+
+// the micro-op only writes registers, so it can be dropped when none of them is read later
+static bool isRemovable(uint8_t kind)
+{
+    switch (kind)
+    {
+        case UOP_SET_IMM: case UOP_ADD_IMM: case UOP_MOV:
+        case UOP_OR: case UOP_AND: case UOP_XOR:
+        case UOP_ADD: case UOP_ADD_NF: case UOP_SUB: case UOP_SUB_NF: case UOP_SUBN: case UOP_SUBN_NF:
+        case UOP_SHR: case UOP_SHR_NF: case UOP_SHL: case UOP_SHL_NF:
+        case UOP_GET_DELAY:
+            return true;
+    }
+    return false;
+}
+
+// registers read and fully overwritten by a micro-op, as bit masks
+static void getEffects(const microOp& op, uint16_t& reads, uint16_t& writes)
+{
+    uint16_t x = 1 << op.dst;
+    uint16_t y = 1 << op.src;
+    uint16_t range = (uint16_t)((2 << op.n) - 1);    // V0..VN
+
+    reads = 0;
+    writes = 0;
+    switch (op.kind)
+    {
+        case UOP_SET_IMM: case UOP_GET_DELAY: case UOP_RAND:
+            writes = x; break;
+        case UOP_ADD_IMM:
+            reads = x; writes = x; break;
+        case UOP_MOV:
+            reads = y; writes = x; break;
+        case UOP_OR: case UOP_AND: case UOP_XOR:
+        case UOP_ADD_NF: case UOP_SUB_NF: case UOP_SUBN_NF:
+            reads = x | y; writes = x; break;
+        case UOP_ADD: case UOP_SUB: case UOP_SUBN:
+            reads = x | y; writes = x | VF_BIT; break;
+        case UOP_SHR_NF: case UOP_SHL_NF:
+            reads = y; writes = x; break;
+        case UOP_SHR: case UOP_SHL:
+            reads = y; writes = x | VF_BIT; break;
+        case UOP_ADD_I:
+            reads = x; writes = VF_BIT; break;
+        case UOP_ADD_I_NF: case UOP_FONT_I: case UOP_SET_DELAY: case UOP_SET_SOUND: case UOP_BCD:
+            reads = x; break;
+        case UOP_STORE:
+            reads = range; break;
+        case UOP_LOAD:
+            writes = range; break;
+        case UOP_DRAW: case UOP_DRAW_WRAP:
+            reads = x | y; writes = VF_BIT; break;
+        case UOP_NOP: case UOP_SET_I: case UOP_CLS:
+            break;
+        default:        // terminators: whatever runs next may read any register
+            reads = 0xFFFF; break;
+    }
+}
+
+static microOp decode(uint16_t opcode, uint16_t address, const quirkSettings& quirks)
+{
+    microOp op;
+    op.kind = UOP_FALLBACK;
+    op.dst = (opcode & 0x0F00) >> 8;
+    op.src = (opcode & 0x00F0) >> 4;
+    op.n = opcode & 0x000F;
+    op.imm = opcode & 0x00FF;
+    op.pc = address;
+
+    // flag-producing ops that also use VF as an operand keep the interpreter's exact ordering
+    bool touchesVF = op.dst == 0xF || op.src == 0xF;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            if (opcode == 0x00E0)
+                op.kind = UOP_CLS;
+            else if (opcode == 0x00EE)
+                op.kind = UOP_RET;
+            break;
+        case 0x1000: op.kind = UOP_JUMP; op.imm = opcode & 0x0FFF; break;
+        case 0x2000: op.kind = UOP_CALL; op.imm = opcode & 0x0FFF; break;
+        case 0x3000: op.kind = UOP_SKIP_EQ_IMM; break;
+        case 0x4000: op.kind = UOP_SKIP_NE_IMM; break;
+        case 0x5000:
+            if (op.n == 0)
+                op.kind = UOP_SKIP_NE_REG;      // matches the interpreter's 5XY0
+            break;
+        case 0x6000: op.kind = UOP_SET_IMM; break;
+        case 0x7000: op.kind = UOP_ADD_IMM; break;
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0: op.kind = UOP_MOV; break;
+                case 0x1: op.kind = UOP_OR; break;
+                case 0x2: op.kind = UOP_AND; break;
+                case 0x3: op.kind = UOP_XOR; break;
+                case 0x4: if (!touchesVF) op.kind = UOP_ADD; break;
+                case 0x5: if (!touchesVF) op.kind = UOP_SUB; break;
+                case 0x6:
+                    op.src = quirks.shiftUsesVY ? op.src : op.dst;
+                    if (op.dst != 0xF && op.src != 0xF)
+                        op.kind = UOP_SHR;
+                    break;
+                case 0x7: if (!touchesVF) op.kind = UOP_SUBN; break;
+                case 0xE:
+                    op.src = quirks.shiftUsesVY ? op.src : op.dst;
+                    if (op.dst != 0xF && op.src != 0xF)
+                        op.kind = UOP_SHL;
+                    break;
+            }
+            break;
+        case 0x9000: op.kind = UOP_SKIP_NE_REG; break;
+        case 0xA000: op.kind = UOP_SET_I; op.imm = opcode & 0x0FFF; break;
+        case 0xB000: op.kind = UOP_JUMP_OFFSET; op.src = quirks.jumpUsesVX ? op.dst : 0; op.imm = opcode & 0x0FFF; break;
+        case 0xC000: op.kind = UOP_RAND; break;
+        case 0xD000: op.kind = quirks.spritesWrap ? UOP_DRAW_WRAP : UOP_DRAW; break;
+        case 0xE000:
+            if ((opcode & 0x00F0) == 0x0090)
+                op.kind = UOP_SKIP_KEY;
+            else if ((opcode & 0x00F0) == 0x00A0)
+                op.kind = UOP_SKIP_NKEY;
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF)
+            {
+                case 0x07: op.kind = UOP_GET_DELAY; break;
+                case 0x15: op.kind = UOP_SET_DELAY; break;
+                case 0x18: op.kind = UOP_SET_SOUND; break;
+                case 0x1E: if (op.dst != 0xF) op.kind = UOP_ADD_I; break;
+                case 0x29: op.kind = UOP_FONT_I; break;
+                case 0x33: op.kind = UOP_BCD; break;
+                case 0x55: op.kind = UOP_STORE; op.n = op.dst; break;
+                case 0x65: op.kind = UOP_LOAD; op.n = op.dst; break;
+                // FX0A and unknown opcodes stay on the interpreter
+            }
+            break;
+    }
+
+    if (op.kind == UOP_STORE || op.kind == UOP_LOAD)
+    {
+        switch (quirks.indexIncrement)
+        {
+            case INDEX_UNCHANGED: op.imm = 0; break;
+            case INDEX_PLUS_X: op.imm = op.n; break;
+            default: op.imm = op.n + 1;
+        }
+    }
+    return op;
+}
+
+
+static inline int lowestBitIndex(uint64_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+chip8IR::chip8IR() : blockAt(MEMORY_SIZE, -1), pageBlocks(MEMORY_PAGES)
+{
+    clear();
+}
+
+// only the entries of live blocks are set, so they are all that has to be undone
+void chip8IR::clear()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        const irBlock& block = blocks[i];
+        if (blockAt[block.start] != (int32_t)i)
+            continue;
+        blockAt[block.start] = -1;
+        for (int page = block.firstPage; page <= block.lastPage; page++)
+            pageBlocks[page].clear();
+    }
+    blocks.clear();
+    freeBlocks.clear();
+    for (int i = 0; i < (MEMORY_PAGES + 63) / 64; i++)
+        writtenPages[i] = 0;
+    anyPageWritten = false;
+}
+
+void chip8IR::dropBlock(int32_t index)
+{
+    const irBlock& block = blocks[index];
+    blockAt[block.start] = -1;
+    freeBlocks.push_back(index);
+    for (int page = block.firstPage; page <= block.lastPage; page++)
+    {
+        std::vector<int32_t>& list = pageBlocks[page];
+        for (size_t i = 0; i < list.size(); i++)
+            if (list[i] == index)
+            {
+                list[i] = list.back();
+                list.pop_back();
+                break;
+            }
+    }
+}
+
+// drops the blocks of the written pages only, whatever the number of blocks translated elsewhere
+void chip8IR::flushWrittenPages()
+{
+    for (int word = 0; word < (MEMORY_PAGES + 63) / 64; word++)
+    {
+        for (uint64_t bits = writtenPages[word]; bits != 0; bits &= bits - 1)
+        {
+            std::vector<int32_t>& list = pageBlocks[word * 64 + lowestBitIndex(bits)];
+            while (!list.empty())
+                dropBlock(list.back());
+        }
+        writtenPages[word] = 0;
+    }
+    anyPageWritten = false;
+}
+
+int32_t chip8IR::translate(const chip8& c8, uint16_t start)
+{
+    irBlock block;
+    block.start = start;
+    block.instructionCount = 0;
+
+    quirkSettings quirks = getQuirkSettings(c8.quirks);
+
+    uint32_t address = start;
+    bool terminated = false;
+    while (!terminated && block.instructionCount < IR_MAX_BLOCK_INSTRUCTIONS && address + 1 <= c8.memoryMask)
+    {
+        microOp op = decode((c8.memory[address] << 8) | c8.memory[address + 1], address, quirks);
+
+        // a skip over the 4-byte XO-CHIP F000 NNNN needs the interpreter's length check
+        if (op.kind >= UOP_SKIP_EQ_IMM && op.kind <= UOP_SKIP_NKEY && c8.isLongInstruction(address + 2))
+            op.kind = UOP_FALLBACK;
+        block.ops.push_back(op);
+        block.instructionCount++;
+        address += 2;
+
+        // VIP logic ops clear VF afterwards; dead-code elimination drops it when VF is not read
+        if (quirks.logicResetsVF && (op.kind == UOP_OR || op.kind == UOP_AND || op.kind == UOP_XOR))
+        {
+            microOp resetFlag = { UOP_SET_IMM, 0xF, 0, 0, 0, op.pc };
+            block.ops.push_back(resetFlag);
+        }
+
+        terminated = isTerminator(op.kind);
+
+        // a store may overwrite the opcodes that follow it, so decoding stops here
+        if (op.kind == UOP_BCD || op.kind == UOP_STORE)
+            break;
+    }
+
+    if (!terminated)
+    {
+        microOp next = { UOP_CONTINUE, 0, 0, 0, (uint16_t)address, (uint16_t)address };
+        block.ops.push_back(next);
+    }
+
+    // also covers the opcode after the block, which a trailing skip looked at
+    uint32_t lastAddress = address + 1 <= c8.memoryMask ? address + 1 : c8.memoryMask;
+    block.firstPage = start / MEMORY_PAGE_SIZE;
+    block.lastPage = lastAddress / MEMORY_PAGE_SIZE;
+
+    propagateConstants(block.ops);
+    eliminateDeadCode(block.ops);
+
+    int32_t index;
+    if (!freeBlocks.empty())
+    {
+        index = freeBlocks.back();
+        freeBlocks.pop_back();
+        blocks[index] = block;
+    }
+    else
+    {
+        index = (int32_t)blocks.size();
+        blocks.push_back(block);
+    }
+    blockAt[start] = index;
+    for (int page = block.firstPage; page <= block.lastPage; page++)
+        pageBlocks[page].push_back(index);
+    return index;
+}
+
+// Forward pass: register renaming (reads of a copied register go to the original) and
+// constant propagation through SET_IMM / ADD_IMM into ALU ops, FX29 and skips.
+void chip8IR::propagateConstants(std::vector<microOp>& ops)
+{
+    bool known[REGS_NUMBER] = { false };
+    uint8_t value[REGS_NUMBER] = { 0 };
+    uint8_t copyOf[REGS_NUMBER];
+    for (int i = 0; i < REGS_NUMBER; i++)
+        copyOf[i] = i;
+
+    std::vector<microOp> result;
+    result.reserve(ops.size() + 4);
+
+    for (size_t i = 0; i < ops.size(); i++)
+    {
+        microOp op = ops[i];
+
+        // register renaming of pure source operands
+        switch (op.kind)
+        {
+            case UOP_SKIP_NE_REG: case UOP_DRAW: case UOP_DRAW_WRAP:
+                op.dst = copyOf[op.dst];
+                op.src = copyOf[op.src];
+                break;
+            case UOP_MOV: case UOP_OR: case UOP_AND: case UOP_XOR:
+            case UOP_ADD: case UOP_SUB: case UOP_SUBN:
+                op.src = copyOf[op.src];
+                break;
+            case UOP_SHR: case UOP_SHL:
+                if (op.src != op.dst)
+                    op.src = copyOf[op.src];
+                break;
+            case UOP_SKIP_EQ_IMM: case UOP_SKIP_NE_IMM: case UOP_SKIP_KEY: case UOP_SKIP_NKEY:
+            case UOP_BCD: case UOP_FONT_I: case UOP_SET_DELAY: case UOP_SET_SOUND: case UOP_ADD_I:
+                op.dst = copyOf[op.dst];
+                break;
+        }
+
+        // constant folding
+        uint8_t x = value[op.dst];
+        uint8_t y = value[op.src];
+        bool knownX = known[op.dst];
+        bool knownY = known[op.src];
+        int flag = -1;      // VF produced by a folded flag op
+        switch (op.kind)
+        {
+            case UOP_ADD_IMM:
+                if (knownX) { op.kind = UOP_SET_IMM; op.imm = (uint8_t)(x + op.imm); }
+                break;
+            case UOP_MOV:
+                if (knownY) { op.kind = UOP_SET_IMM; op.imm = y; }
+                break;
+            case UOP_OR:
+                if (knownX && knownY) { op.kind = UOP_SET_IMM; op.imm = x | y; }
+                break;
+            case UOP_AND:
+                if (knownX && knownY) { op.kind = UOP_SET_IMM; op.imm = x & y; }
+                break;
+            case UOP_XOR:
+                if (knownX && knownY) { op.kind = UOP_SET_IMM; op.imm = x ^ y; }
+                break;
+            case UOP_ADD:
+                if (knownX && knownY) { flag = y > 0xFF - x ? 1 : 0; op.kind = UOP_SET_IMM; op.imm = (uint8_t)(x + y); }
+                break;
+            case UOP_SUB:
+                if (knownX && knownY) { flag = x < y ? 0 : 1; op.kind = UOP_SET_IMM; op.imm = (uint8_t)(x - y); }
+                break;
+            case UOP_SUBN:
+                if (knownX && knownY) { flag = y < x ? 0 : 1; op.kind = UOP_SET_IMM; op.imm = (uint8_t)(y - x); }
+                break;
+            case UOP_SHR:
+                if (knownY) { flag = y & 0x01; op.kind = UOP_SET_IMM; op.imm = y >> 1; }
+                break;
+            case UOP_SHL:
+                if (knownY) { flag = (y & 0x80) >> 7; op.kind = UOP_SET_IMM; op.imm = (uint8_t)(y << 1); }
+                break;
+            case UOP_FONT_I:
+                if (knownX) { op.kind = UOP_SET_I; op.imm = x * 0x5; }
+                break;
+            case UOP_SKIP_EQ_IMM:
+                if (knownX) { op.kind = UOP_JUMP; op.imm = op.pc + (x == op.imm ? 4 : 2); }
+                break;
+            case UOP_SKIP_NE_IMM:
+                if (knownX) { op.kind = UOP_JUMP; op.imm = op.pc + (x != op.imm ? 4 : 2); }
+                break;
+            case UOP_SKIP_NE_REG:
+                if (op.dst == op.src) { op.kind = UOP_JUMP; op.imm = op.pc + 2; }
+                else if (knownX && knownY) { op.kind = UOP_JUMP; op.imm = op.pc + (x != y ? 4 : 2); }
+                break;
+            case UOP_JUMP_OFFSET:
+                if (knownY) { op.kind = UOP_JUMP; op.imm += y; }
+                break;
+        }
+
+        microOp emitted[2];
+        int count = 0;
+        if (flag >= 0)
+        {
+            microOp flagOp = { UOP_SET_IMM, 0xF, 0, 0, (uint16_t)flag, op.pc };
+            emitted[count++] = flagOp;
+        }
+        emitted[count++] = op;
+
+        for (int j = 0; j < count; j++)
+        {
+            const microOp& e = emitted[j];
+            uint16_t reads, writes;
+            getEffects(e, reads, writes);
+            if (isTerminator(e.kind))
+                writes = 0;
+
+            for (int r = 0; r < REGS_NUMBER; r++)
+            {
+                if ((writes & (1 << r)) == 0)
+                    continue;
+                known[r] = false;
+                copyOf[r] = r;
+                for (int k = 0; k < REGS_NUMBER; k++)
+                    if (copyOf[k] == r)
+                        copyOf[k] = k;
+            }
+
+            if (e.kind == UOP_SET_IMM)
+            {
+                known[e.dst] = true;
+                value[e.dst] = (uint8_t)e.imm;
+            }
+            else if (e.kind == UOP_MOV && e.dst != e.src && e.dst != 0xF && e.src != 0xF)
+                copyOf[e.dst] = e.src;
+
+            result.push_back(e);
+        }
+    }
+
+    ops.swap(result);
+}
+
+// Backward pass over register liveness: flag ops whose VF is overwritten before being read
+// switch to their no-flag variant, and pure ops whose results are never read are removed.
+void chip8IR::eliminateDeadCode(std::vector<microOp>& ops)
+{
+    uint16_t live = 0xFFFF;     // all registers are live when the block exits
+
+    for (int i = (int)ops.size() - 1; i >= 0; i--)
+    {
+        microOp& op = ops[i];
+
+        if ((live & VF_BIT) == 0)
+        {
+            switch (op.kind)
+            {
+                case UOP_ADD: op.kind = UOP_ADD_NF; break;
+                case UOP_SUB: op.kind = UOP_SUB_NF; break;
+                case UOP_SUBN: op.kind = UOP_SUBN_NF; break;
+                case UOP_SHR: op.kind = UOP_SHR_NF; break;
+                case UOP_SHL: op.kind = UOP_SHL_NF; break;
+                case UOP_ADD_I: op.kind = UOP_ADD_I_NF; break;
+            }
+        }
+
+        uint16_t reads, writes;
+        getEffects(op, reads, writes);
+        if (isRemovable(op.kind) && (writes & live) == 0)
+        {
+            op.kind = UOP_NOP;
+            continue;
+        }
+        live = (live & ~writes) | reads;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < ops.size(); i++)
+        if (ops[i].kind != UOP_NOP)
+            ops[kept++] = ops[i];
+    ops.resize(kept);
+}
+
+int chip8IR::executeBlock(chip8& c8)
+{
+    if (c8.waitingForKey || c8.halted)
+        return 0;
+
+    // pc at or past the end of the addressable memory is left to the interpreter, which wraps it
+    if (c8.pc >= c8.memoryMask)
+    {
+        c8.executeCycle(1);
+        return 1;
+    }
+
+    if (anyPageWritten)
+        flushWrittenPages();
+
+    int32_t index = blockAt[c8.pc];
+    if (index < 0)
+        index = translate(c8, c8.pc);
+
+    const irBlock& block = blocks[index];
+    c8.executedInstructions += block.instructionCount;
+
+    uint8_t* V = c8.V;
+    for (const microOp* op = block.ops.data(); ; op++)
+    {
+        switch (op->kind)
+        {
+            case UOP_NOP:
+                break;
+            case UOP_SET_IMM:
+                V[op->dst] = (uint8_t)op->imm;
+                break;
+            case UOP_ADD_IMM:
+                V[op->dst] += (uint8_t)op->imm;
+                break;
+            case UOP_MOV:
+                V[op->dst] = V[op->src];
+                break;
+            case UOP_OR:
+                V[op->dst] |= V[op->src];
+                break;
+            case UOP_AND:
+                V[op->dst] &= V[op->src];
+                break;
+            case UOP_XOR:
+                V[op->dst] ^= V[op->src];
+                break;
+            case UOP_ADD:
+                V[0xF] = V[op->src] > (0xFF - V[op->dst]) ? 1 : 0;
+                V[op->dst] += V[op->src];
+                break;
+            case UOP_ADD_NF:
+                V[op->dst] += V[op->src];
+                break;
+            case UOP_SUB:
+                V[0xF] = V[op->dst] < V[op->src] ? 0 : 1;
+                V[op->dst] -= V[op->src];
+                break;
+            case UOP_SUB_NF:
+                V[op->dst] -= V[op->src];
+                break;
+            case UOP_SUBN:
+                V[0xF] = V[op->src] < V[op->dst] ? 0 : 1;
+                V[op->dst] = V[op->src] - V[op->dst];
+                break;
+            case UOP_SUBN_NF:
+                V[op->dst] = V[op->src] - V[op->dst];
+                break;
+            case UOP_SHR:
+                V[0xF] = V[op->src] & 0x01;
+                V[op->dst] = V[op->src] >> 1;
+                break;
+            case UOP_SHR_NF:
+                V[op->dst] = V[op->src] >> 1;
+                break;
+            case UOP_SHL:
+                V[0xF] = (V[op->src] & 0x80) >> 7;
+                V[op->dst] = V[op->src] << 1;
+                break;
+            case UOP_SHL_NF:
+                V[op->dst] = V[op->src] << 1;
+                break;
+            case UOP_SET_I:
+                c8.I = op->imm;
+                break;
+            case UOP_ADD_I:
+                V[0xF] = c8.I + V[op->dst] > 0xFFF ? 1 : 0;
+                c8.I += V[op->dst];
+                break;
+            case UOP_ADD_I_NF:
+                c8.I += V[op->dst];
+                break;
+            case UOP_FONT_I:
+                c8.I = V[op->dst] * 0x5;
+                break;
+            case UOP_GET_DELAY:
+                V[op->dst] = c8.delayTimer;
+                break;
+            case UOP_SET_DELAY:
+                c8.delayTimer = V[op->dst];
+                break;
+            case UOP_SET_SOUND:
+                c8.soundTimer = V[op->dst];
+                break;
+            case UOP_RAND:
+                V[op->dst] = op->imm & c8.nextRandom();
+                break;
+            case UOP_BCD:
+                c8.memory[(c8.I + 0) & c8.memoryMask] = V[op->dst] / 100;
+                c8.memory[(c8.I + 1) & c8.memoryMask] = (V[op->dst] / 10) % 10;
+                c8.memory[(c8.I + 2) & c8.memoryMask] = V[op->dst] % 10;
+                c8.onMemoryWrite(c8.I, 3);
+                break;
+            case UOP_STORE:
+                for (int i = 0; i <= op->n; i++)
+                    c8.memory[(c8.I + i) & c8.memoryMask] = V[i];
+                c8.onMemoryWrite(c8.I, op->n + 1);
+                c8.I += op->imm;
+                break;
+            case UOP_LOAD:
+                for (int i = 0; i <= op->n; i++)
+                    V[i] = c8.memory[(c8.I + i) & c8.memoryMask];
+                c8.I += op->imm;
+                break;
+            case UOP_DRAW:
+                c8.drawSprite<false>(op->dst, op->src, op->n);
+                break;
+            case UOP_DRAW_WRAP:
+                c8.drawSprite<true>(op->dst, op->src, op->n);
+                break;
+            case UOP_CLS:
+                c8.clearDisplay();
+                break;
+
+            case UOP_CONTINUE:
+            case UOP_JUMP:
+                c8.pc = op->imm;
+                return block.instructionCount;
+            case UOP_JUMP_OFFSET:
+                c8.pc = op->imm + V[op->src];
+                return block.instructionCount;
+            case UOP_CALL:
+                c8.stack[c8.stackLevel++ % STACK_LEVELS] = op->pc;
+                c8.pc = op->imm;
+                return block.instructionCount;
+            case UOP_RET:
+                c8.pc = c8.stack[--c8.stackLevel % STACK_LEVELS] + 2;
+                return block.instructionCount;
+            case UOP_SKIP_EQ_IMM:
+                c8.pc = op->pc + (V[op->dst] == op->imm ? 4 : 2);
+                return block.instructionCount;
+            case UOP_SKIP_NE_IMM:
+                c8.pc = op->pc + (V[op->dst] != op->imm ? 4 : 2);
+                return block.instructionCount;
+            case UOP_SKIP_NE_REG:
+                c8.pc = op->pc + (V[op->dst] != V[op->src] ? 4 : 2);
+                return block.instructionCount;
+            case UOP_SKIP_KEY:
+                c8.keyReads++;
+                c8.pc = op->pc + (c8.key[V[op->dst] & 0x0F] != 0 ? 4 : 2);
+                return block.instructionCount;
+            case UOP_SKIP_NKEY:
+                c8.keyReads++;
+                c8.pc = op->pc + (c8.key[V[op->dst] & 0x0F] == 0 ? 4 : 2);
+                return block.instructionCount;
+            case UOP_FALLBACK:
+                c8.pc = op->pc;
+                c8.opcode = (c8.memory[op->pc] << 8) | c8.memory[op->pc + 1];
+                c8.executeOpcode();
+                return block.instructionCount;
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include "chip8_latency.h"
+
+
+void latencyHistogram::record(uint64_t nanoseconds)
+{
+    uint64_t bucket = nanoseconds / LATENCY_BUCKET_NS;
+    buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+    samples++;
+    if (nanoseconds > maximum)
+        maximum = nanoseconds;
+}
+
+uint64_t latencyHistogram::percentile(double fraction) const
+{
+    if (samples == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(fraction * samples + 0.5);
+    if (target == 0)
+        target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+        {
+            uint64_t edge = (uint64_t)(i + 1) * LATENCY_BUCKET_NS;
+            return i < LATENCY_BUCKETS - 1 && edge < maximum ? edge : maximum;
+        }
+    }
+    return maximum;
+}
+
+uint64_t inputLatencyTracker::hashDisplay(const chip8& c8)
+{
+    // the planes are one contiguous block starting at the first row
+    return hashRom((const uint8_t*)c8.getDisplayRow(0, 0), sizeof(uint64_t) * DISPLAY_PLANES * DISPLAY_HIRES_HEIGHT * DISPLAY_ROW_WORDS);
+}
+
+void inputLatencyTracker::onKeyPressed(uint64_t now, const chip8& c8)
+{
+    if (current != STAGE_IDLE)
+        return;
+
+    current = STAGE_WAITING_FOR_READ;
+    pressTime = now;
+    keyReadsAtPress = c8.getKeyReads();
+    displayHash = hashDisplay(c8);
+    framesWaited = 0;
+}
+
+void inputLatencyTracker::onFrame(uint64_t now, const chip8& c8)
+{
+    if (current != STAGE_WAITING_FOR_READ && current != STAGE_WAITING_FOR_CHANGE)
+        return;
+
+    if (++framesWaited > LATENCY_TIMEOUT_FRAMES)
+    {
+        abandoned++;
+        current = STAGE_IDLE;
+        return;
+    }
+
+    // the hash is only computed while a press is being followed
+    uint64_t hash = hashDisplay(c8);
+    if (current == STAGE_WAITING_FOR_READ && c8.getKeyReads() != keyReadsAtPress)
+        current = STAGE_WAITING_FOR_CHANGE;
+    if (current == STAGE_WAITING_FOR_CHANGE && hash != displayHash)
+    {
+        inputToFrame.record(now - pressTime);
+        frameTime = now;
+        current = STAGE_WAITING_FOR_PRESENT;
+    }
+    displayHash = hash;
+}
+
+void inputLatencyTracker::onPresented(uint64_t now)
+{
+    if (current != STAGE_WAITING_FOR_PRESENT)
+        return;
+
+    frameToPhoton.record(now - frameTime);
+    current = STAGE_IDLE;
+}
+
+void inputLatencyTracker::report(FILE* output) const
+{
+    const latencyHistogram* histograms[2] = { &inputToFrame, &frameToPhoton };
+    const char* names[2] = { "key to changed frame", "frame to swap" };
+    for (int i = 0; i < 2; i++)
+    {
+        const latencyHistogram& histogram = *histograms[i];
+        fprintf(output, "%-22s %6llu samples, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", names[i],
+            (unsigned long long)histogram.getSamples(), histogram.percentile(0.50) / 1e6,
+            histogram.percentile(0.99) / 1e6, histogram.getMaximum() / 1e6);
+    }
+    if (abandoned > 0)
+        fprintf(output, "%llu presses without a visible reaction\n", (unsigned long long)abandoned);
+}
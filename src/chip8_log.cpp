@@ -0,0 +1,335 @@
+#include "chip8_log.h"
+#include <cstdio>
+#include <cstring>
+
+
+chip8Logger::chip8Logger(uint32_t maxPerSecond)
+    : queue(LOG_QUEUE_CAPACITY), enqueuePosition(0), dequeuePosition(0), minimumLevel(LOG_INFO), dropped(0),
+      rateBuckets(LOG_RATE_BUCKETS), ratePerSecond(maxPerSecond), sink(NULL), sinkContext(NULL), created(std::chrono::steady_clock::now()),
+      running(true), drainedPosition(0), sleeping(false), wakePending(false)
+{
+    for (size_t i = 0; i < queue.size(); i++)
+        queue[i].sequence.store(i, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < rateBuckets.size(); i++)
+    {
+        rateBucket& bucket = rateBuckets[i];
+        bucket.key.store(0, std::memory_order_relaxed);
+        bucket.source.store(NULL, std::memory_order_relaxed);
+        bucket.site.store(0, std::memory_order_relaxed);
+        bucket.opcode.store(0, std::memory_order_relaxed);
+        bucket.windowStart.store(0, std::memory_order_relaxed);
+        bucket.windowCount.store(0, std::memory_order_relaxed);
+        bucket.suppressed.store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < LOG_EVENTS_NUMBER; i++)
+        suppressed[i].store(0, std::memory_order_relaxed);
+
+    worker = std::thread(&chip8Logger::run, this);
+}
+
+chip8Logger::~chip8Logger()
+{
+    running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wakePending = true;
+    }
+    wakeup.notify_one();
+    worker.join();
+}
+
+uint64_t chip8Logger::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - created).count();
+}
+
+void chip8Logger::setSink(logSink newSink, void* context)
+{
+    std::lock_guard<std::mutex> lock(sinkMutex);
+    sink = newSink;
+    sinkContext = context;
+}
+
+// mixes the fields a rate window is kept for; never 0, which marks an unused bucket
+static uint64_t rateKey(const void* source, logEvent event, uint16_t pc, uint16_t opcode)
+{
+    uint64_t key = (uint64_t)(uintptr_t)source * 0x9E3779B97F4A7C15ULL;
+    key ^= ((uint64_t)event << 32 | (uint64_t)pc << 16 | opcode) * 0xC2B2AE3D27D4EB4FULL;
+    key ^= key >> 29;
+    return key | 1;
+}
+
+void chip8Logger::log(logLevel level, logEvent event, const void* source, uint16_t pc, uint16_t opcode,
+    uint32_t value, const char* text)
+{
+    if (!isEnabled(level))
+        return;
+
+    // at most ratePerSecond records of one (source, event, pc, opcode) per one-second window, so a
+    // flood from one ROM or one address does not silence the others
+    uint64_t key = rateKey(source, event, pc, opcode);
+    rateBucket& bucket = rateBuckets[(key >> 32) & (rateBuckets.size() - 1)];
+    uint64_t owner = bucket.key.load(std::memory_order_relaxed);
+    if (owner != key && bucket.key.compare_exchange_strong(owner, key))
+    {
+        uint32_t count = bucket.suppressed.exchange(0, std::memory_order_relaxed);
+        if (owner != 0 && count > 0)
+            suppressed[bucket.site.load(std::memory_order_relaxed) >> 16].fetch_add(count, std::memory_order_relaxed);
+        bucket.source.store(source, std::memory_order_relaxed);
+        bucket.site.store((uint32_t)event << 16 | pc, std::memory_order_relaxed);
+        bucket.opcode.store(opcode, std::memory_order_relaxed);
+    }
+
+    uint64_t time = now();
+    uint64_t start = bucket.windowStart.load(std::memory_order_relaxed);
+    if (time - start >= 1000000000ULL && bucket.windowStart.compare_exchange_strong(start, time))
+        bucket.windowCount.store(0, std::memory_order_relaxed);
+    if (bucket.windowCount.fetch_add(1, std::memory_order_relaxed) >= ratePerSecond)
+    {
+        bucket.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // bounded MPMC queue (Vyukov): claim a slot whose sequence says it is free, then publish it
+    size_t mask = queue.size() - 1;
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    slot* target;
+    for (;;)
+    {
+        target = &queue[position & mask];
+        size_t sequence = target->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0)
+        {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);    // full; never wait for the logger thread
+            return;
+        }
+        else
+            position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+
+    logRecord& record = target->record;
+    record.time = time;
+    record.source = source;
+    record.value = value;
+    record.pc = pc;
+    record.opcode = opcode;
+    record.level = level;
+    record.event = event;
+    record.text[0] = '\0';
+    if (text != NULL)
+    {
+        // keep the end of long strings such as file paths
+        size_t length = strlen(text);
+        const char* tail = length >= LOG_TEXT_SIZE ? text + length - (LOG_TEXT_SIZE - 1) : text;
+        strncpy(record.text, tail, LOG_TEXT_SIZE - 1);
+        record.text[LOG_TEXT_SIZE - 1] = '\0';
+    }
+    target->sequence.store(position + 1, std::memory_order_release);
+    wake();
+}
+
+// called after publishing a record; the fence pairs with the one in run(), so either the logger
+// thread sees the record before it sleeps or this sees sleeping and wakes it
+void chip8Logger::wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.load(std::memory_order_relaxed))
+        return;
+
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakePending = true;
+    wakeup.notify_one();
+}
+
+bool chip8Logger::isQueueEmpty() const
+{
+    const slot& next = queue[dequeuePosition & (queue.size() - 1)];
+    return next.sequence.load(std::memory_order_acquire) != dequeuePosition + 1;
+}
+
+bool chip8Logger::dequeue(logRecord& record)
+{
+    slot& source = queue[dequeuePosition & (queue.size() - 1)];
+    size_t sequence = source.sequence.load(std::memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(dequeuePosition + 1) < 0)
+        return false;
+
+    record = source.record;
+    source.sequence.store(dequeuePosition + queue.size(), std::memory_order_release);
+    dequeuePosition++;
+    return true;
+}
+
+static bool isRepeat(const logRecord& a, const logRecord& b)
+{
+    return a.event == b.event && a.level == b.level && a.source == b.source && a.pc == b.pc
+        && a.opcode == b.opcode && a.value == b.value && strcmp(a.text, b.text) == 0;
+}
+
+void chip8Logger::emit(const logRecord& record, uint32_t repeats)
+{
+    if (sink != NULL)
+        sink(record, repeats, sinkContext);
+}
+
+// moves everything queued to the sink, collapsing runs of identical records
+void chip8Logger::drain()
+{
+    std::lock_guard<std::mutex> lock(sinkMutex);
+
+    logRecord pending;
+    logRecord record;
+    uint32_t repeats = 0;
+    while (dequeue(record))
+    {
+        if (repeats > 0 && isRepeat(pending, record))
+        {
+            repeats++;
+            continue;
+        }
+        if (repeats > 0)
+            emit(pending, repeats);
+        pending = record;
+        repeats = 1;
+    }
+    if (repeats > 0)
+        emit(pending, repeats);
+
+    // one summary per rate-limited key, then the counts of keys that lost their bucket
+    for (size_t i = 0; i < rateBuckets.size(); i++)
+    {
+        rateBucket& bucket = rateBuckets[i];
+        uint32_t count = bucket.suppressed.exchange(0, std::memory_order_relaxed);
+        if (count == 0)
+            continue;
+
+        uint32_t site = bucket.site.load(std::memory_order_relaxed);
+        logRecord summary;
+        memset(&summary, 0, sizeof(summary));
+        summary.time = now();
+        summary.source = bucket.source.load(std::memory_order_relaxed);
+        summary.pc = (uint16_t)site;
+        summary.opcode = bucket.opcode.load(std::memory_order_relaxed);
+        summary.level = LOG_WARNING;
+        summary.event = LOG_RATE_LIMITED;
+        summary.value = site >> 16;
+        emit(summary, count);
+    }
+    for (int event = 0; event < LOG_EVENTS_NUMBER; event++)
+    {
+        uint32_t count = suppressed[event].exchange(0, std::memory_order_relaxed);
+        if (count == 0)
+            continue;
+
+        logRecord summary;
+        memset(&summary, 0, sizeof(summary));
+        summary.time = now();
+        summary.level = LOG_WARNING;
+        summary.event = LOG_RATE_LIMITED;
+        summary.value = event;
+        emit(summary, count);
+    }
+
+    drainedPosition.store(dequeuePosition, std::memory_order_release);
+}
+
+void chip8Logger::run()
+{
+    while (running.load())
+    {
+        drain();
+
+        // sleep until a record is pushed or the logger is destroyed; records the rate limiter drops
+        // push nothing, so their counts wait for the timeout
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (isQueueEmpty())
+            wakeup.wait_for(lock, std::chrono::milliseconds(LOG_IDLE_WAKEUP_MS),
+                [this] { return wakePending || !running.load(); });
+        wakePending = false;
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+    drain();
+}
+
+void chip8Logger::flush()
+{
+    uint64_t target = enqueuePosition.load();
+    while (drainedPosition.load(std::memory_order_acquire) < target)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+const char* chip8Logger::getEventName(logEvent event)
+{
+    switch (event)
+    {
+        case LOG_UNKNOWN_OPCODE: return "unknown-opcode";
+        case LOG_PROGRAM_EXIT: return "program-exit";
+        case LOG_SOUND_STOPPED: return "sound-stopped";
+        case LOG_ROM_OPENED: return "rom-opened";
+        case LOG_ROM_OPEN_FAILED: return "rom-open-failed";
+        case LOG_ROM_READ_FAILED: return "rom-read-failed";
+        case LOG_ROM_TOO_BIG: return "rom-too-big";
+        case LOG_RATE_LIMITED: return "rate-limited";
+        default: return "unknown-event";
+    }
+}
+
+void chip8Logger::formatRecord(const logRecord& record, uint32_t repeats, char* buffer, size_t size)
+{
+    static const char* levelNames[] = { "debug", "info", "warning", "error" };
+
+    char message[128];
+    switch (record.event)
+    {
+        case LOG_UNKNOWN_OPCODE:
+            snprintf(message, sizeof(message), "unknown opcode 0x%04X at 0x%04X", record.opcode, record.pc);
+            break;
+        case LOG_PROGRAM_EXIT:
+            snprintf(message, sizeof(message), "program exited at 0x%04X", record.pc);
+            break;
+        case LOG_SOUND_STOPPED:
+            snprintf(message, sizeof(message), "BEEP!");
+            break;
+        case LOG_ROM_OPENED:
+            snprintf(message, sizeof(message), "read %s, %u bytes", record.text, record.value);
+            break;
+        case LOG_ROM_OPEN_FAILED:
+            snprintf(message, sizeof(message), "failed to open %s", record.text);
+            break;
+        case LOG_ROM_READ_FAILED:
+            snprintf(message, sizeof(message), "failed to read %s", record.text);
+            break;
+        case LOG_ROM_TOO_BIG:
+            snprintf(message, sizeof(message), "application ROM is too big (%u bytes)", record.value);
+            break;
+        case LOG_RATE_LIMITED:
+            if (record.pc != 0 || record.opcode != 0)
+                snprintf(message, sizeof(message), "%u %s records (0x%04X at 0x%04X) dropped by the rate limiter",
+                    repeats, getEventName((logEvent)record.value), record.opcode, record.pc);
+            else
+                snprintf(message, sizeof(message), "%u %s records dropped by the rate limiter", repeats,
+                    getEventName((logEvent)record.value));
+            repeats = 1;
+            break;
+        default:
+            snprintf(message, sizeof(message), "%s", getEventName((logEvent)record.event));
+    }
+
+    const char* level = record.level < 4 ? levelNames[record.level] : "?";
+    int length = snprintf(buffer, size, "[%12.6f] %s: %s", record.time / 1e9, level, message);
+    if (length >= 0 && (size_t)length < size && record.source != NULL)
+        length += snprintf(buffer + length, size - length, " (chip8 %p)", record.source);
+    if (length >= 0 && (size_t)length < size && repeats > 1)
+        length += snprintf(buffer + length, size - length, " (repeated %u times)", repeats);
+    if (length >= 0 && (size_t)length < size)
+        snprintf(buffer + length, size - length, "\n");
+}
@@ -0,0 +1,24 @@
+#include "chip8_logsink.h"
+#include <cstdio>
+
+
+void writeLogToStderr(const logRecord& record, uint32_t repeats, void*)
+{
+    char line[256];
+    chip8Logger::formatRecord(record, repeats, line, sizeof(line));
+    fputs(line, stderr);
+}
+
+// the sink is set before the logger is handed out, so no record is ever discarded
+static chip8Logger& createDefaultLogger()
+{
+    static chip8Logger logger;
+    logger.setSink(writeLogToStderr, NULL);
+    return logger;
+}
+
+chip8Logger& getDefaultLogger()
+{
+    static chip8Logger& logger = createDefaultLogger();
+    return logger;
+}
@@ -0,0 +1,385 @@
+#include "chip8_netplay.h"
+#include <cstring>
+#include <chrono>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define HAVE_BSD_SOCKETS
+#endif
+
+#define NETPLAY_PACKET_MAGIC 0xC8
+#define NETPLAY_HEADER_SIZE 23
+#define NO_CHECKSUM 0xFFFFFFFF
+
+
+static uint64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putLittleEndian(uint8_t* bytes, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+        bytes[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t getLittleEndian(const uint8_t* bytes, int size)
+{
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+
+udpChannel::udpChannel()
+    : socketHandle(-1), remoteAddressSize(0), latency(0), lossRate(0), randomState(1), sentPackets(0), lostPackets(0)
+{
+    memset(remoteAddress, 0, sizeof(remoteAddress));
+}
+
+bool udpChannel::open(uint16_t localPort, const char* remoteHost, uint16_t remotePort)
+{
+    close();
+#ifdef HAVE_BSD_SOCKETS
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", remotePort);
+    addrinfo* found = NULL;
+    if (getaddrinfo(remoteHost, port, &hints, &found) != 0 || found == NULL)
+        return false;
+    bool fits = found->ai_addrlen <= sizeof(remoteAddress);
+    if (fits)
+    {
+        memcpy(remoteAddress, found->ai_addr, found->ai_addrlen);
+        remoteAddressSize = (uint32_t)found->ai_addrlen;
+    }
+    freeaddrinfo(found);
+    if (!fits)
+        return false;
+
+    socketHandle = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socketHandle < 0)
+        return false;
+
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(localPort);
+    if (bind(socketHandle, (sockaddr*)&local, sizeof(local)) != 0
+        || fcntl(socketHandle, F_SETFL, fcntl(socketHandle, F_GETFL, 0) | O_NONBLOCK) != 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void udpChannel::close()
+{
+#ifdef HAVE_BSD_SOCKETS
+    if (socketHandle >= 0)
+        ::close(socketHandle);
+#endif
+    socketHandle = -1;
+    delayed.clear();
+}
+
+void udpChannel::setImpairment(uint32_t latencyMilliseconds, double lossFraction, uint32_t seed)
+{
+    latency = (uint64_t)latencyMilliseconds * 1000000;
+    lossRate = lossFraction;
+    randomState = seed != 0 ? seed : 1;
+}
+
+void udpChannel::send(const uint8_t* data, size_t size)
+{
+    if (socketHandle < 0 || size > NETPLAY_MAX_PACKET)
+        return;
+    sentPackets++;
+
+    // synthetic loss: xorshift32, so an impaired run is repeatable from its seed
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    if (randomState < lossRate * 4294967296.0)
+    {
+        lostPackets++;
+        return;
+    }
+
+    uint64_t now = steadyNanoseconds();
+    if (latency > 0)
+    {
+        delayedPacket packet;
+        packet.sendTime = now + latency;
+        packet.size = size;
+        memcpy(packet.data, data, size);
+        delayed.push_back(packet);
+        flushDelayed(now);
+        return;
+    }
+#ifdef HAVE_BSD_SOCKETS
+    sendto(socketHandle, data, size, 0, (const sockaddr*)remoteAddress, remoteAddressSize);
+#endif
+}
+
+// sends the held-back packets whose latency has passed, oldest first
+void udpChannel::flushDelayed(uint64_t now)
+{
+    size_t sent = 0;
+    while (sent < delayed.size() && delayed[sent].sendTime <= now)
+    {
+#ifdef HAVE_BSD_SOCKETS
+        sendto(socketHandle, delayed[sent].data, delayed[sent].size, 0, (const sockaddr*)remoteAddress, remoteAddressSize);
+#endif
+        sent++;
+    }
+    delayed.erase(delayed.begin(), delayed.begin() + sent);
+}
+
+size_t udpChannel::receive(uint8_t* data, size_t capacity)
+{
+    if (socketHandle < 0)
+        return 0;
+    flushDelayed(steadyNanoseconds());
+#ifdef HAVE_BSD_SOCKETS
+    ssize_t size = recv(socketHandle, data, capacity, 0);
+    return size > 0 ? (size_t)size : 0;
+#else
+    return 0;
+#endif
+}
+
+
+rollbackSession::rollbackSession(chip8& emulator, udpChannel& peer, int player, int cycles)
+    : c8(emulator), channel(peer), localPlayer(player), cyclesPerFrame(cycles), frame(0),
+      snapshots(NETPLAY_MAX_ROLLBACK + 2), confirmedRemoteFrame(-1), remoteAckFrame(-1), rollbackFrom(-1),
+      nextChecksumFrame(NETPLAY_CHECKSUM_INTERVAL), sentChecksumFrame(NO_CHECKSUM), sentChecksum(0),
+      remoteChecksumFrame(NO_CHECKSUM), remoteChecksum(0)
+{
+    for (int i = 0; i < NETPLAY_INPUT_WINDOW; i++)
+    {
+        localInputs[i] = 0;
+        remoteInputs[i] = 0;
+        remoteFrames[i] = -1;
+        localChecksums[i] = 0;
+        localChecksumFrames[i] = NO_CHECKSUM;
+    }
+    memset(&stats, 0, sizeof(stats));
+    stats.lastChecksumFrame = NO_CHECKSUM;
+}
+
+uint64_t rollbackSession::hashState(const chip8State& state, size_t memorySize)
+{
+    // FNV-1a over the fields that define the future of the machine; padding is left out
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    const struct { const void* data; size_t size; } fields[] =
+    {
+        { &state.pc, sizeof(state.pc) }, { &state.I, sizeof(state.I) }, { state.V, sizeof(state.V) },
+        { &state.stackLevel, sizeof(state.stackLevel) }, { state.stack, sizeof(state.stack) },
+        { &state.delayTimer, sizeof(state.delayTimer) }, { &state.soundTimer, sizeof(state.soundTimer) },
+        { &state.waitingForKey, sizeof(state.waitingForKey) }, { &state.keyWaitRegister, sizeof(state.keyWaitRegister) },
+        { &state.halted, sizeof(state.halted) }, { &state.hires, sizeof(state.hires) }, { &state.planeMask, sizeof(state.planeMask) },
+        { &state.randomState, sizeof(state.randomState) }, { state.key, sizeof(state.key) },
+        { state.rplFlags, sizeof(state.rplFlags) }, { &state.pitch, sizeof(state.pitch) },
+        { state.display, sizeof(state.display) }, { state.memory, memorySize }
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        const uint8_t* bytes = (const uint8_t*)fields[i].data;
+        for (size_t j = 0; j < fields[i].size; j++)
+        {
+            hash ^= bytes[j];
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    return hash;
+}
+
+uint16_t rollbackSession::predictRemote() const
+{
+    // the remote player keeps holding what they held in the last confirmed frame
+    return confirmedRemoteFrame >= 0 ? remoteInputs[confirmedRemoteFrame % NETPLAY_INPUT_WINDOW] : 0;
+}
+
+void rollbackSession::runFrame(uint32_t f)
+{
+    uint16_t keys = localInputs[f % NETPLAY_INPUT_WINDOW] | remoteInputs[f % NETPLAY_INPUT_WINDOW];
+    for (int k = 0; k < KEYS_NUMBER; k++)
+    {
+        bool pressed = (keys >> k) & 1;
+        if ((c8.getState().key[k] != 0) != pressed)
+            c8.setKey((uint8_t)k, pressed);
+    }
+
+    c8.executeInstructions(cyclesPerFrame);
+    c8.tickTimers();
+}
+
+void rollbackSession::receivePackets()
+{
+    uint8_t packet[NETPLAY_MAX_PACKET];
+    size_t size;
+    while ((size = channel.receive(packet, sizeof(packet))) > 0)
+    {
+        if (size < NETPLAY_HEADER_SIZE || packet[0] != NETPLAY_PACKET_MAGIC || packet[1] == localPlayer)
+            continue;
+        uint32_t firstFrame = (uint32_t)getLittleEndian(packet + 2, 4);
+        int count = packet[6];
+        if (size < NETPLAY_HEADER_SIZE + 2 * (size_t)count)
+            continue;
+
+        int32_t ack = (int32_t)getLittleEndian(packet + 7, 4);
+        if (ack > remoteAckFrame)
+            remoteAckFrame = ack;
+
+        uint32_t checksumFrame = (uint32_t)getLittleEndian(packet + 11, 4);
+        if (checksumFrame != NO_CHECKSUM && (remoteChecksumFrame == NO_CHECKSUM || checksumFrame > remoteChecksumFrame))
+        {
+            remoteChecksumFrame = checksumFrame;
+            remoteChecksum = getLittleEndian(packet + 15, 8);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            int64_t f = (int64_t)firstFrame + i;
+            if (f <= confirmedRemoteFrame || f >= (int64_t)frame + NETPLAY_INPUT_WINDOW / 2)
+                continue;
+            int slot = f % NETPLAY_INPUT_WINDOW;
+            if (remoteFrames[slot] == f)
+                continue;
+
+            uint16_t keys = (uint16_t)getLittleEndian(packet + NETPLAY_HEADER_SIZE + 2 * i, 2);
+            if (f < frame && keys != remoteInputs[slot] && (rollbackFrom < 0 || f < rollbackFrom))
+                rollbackFrom = f;
+            remoteInputs[slot] = keys;
+            remoteFrames[slot] = f;
+        }
+
+        while (remoteFrames[(confirmedRemoteFrame + 1) % NETPLAY_INPUT_WINDOW] == confirmedRemoteFrame + 1)
+            confirmedRemoteFrame++;
+    }
+}
+
+void rollbackSession::sendInputs()
+{
+    // every local input the remote has not acknowledged yet, up to NETPLAY_REDUNDANT_INPUTS of them,
+    // so a lost packet is covered by the next one
+    int64_t first = (int64_t)remoteAckFrame + 1;
+    if (first < (int64_t)frame - NETPLAY_REDUNDANT_INPUTS)
+        first = (int64_t)frame - NETPLAY_REDUNDANT_INPUTS;
+    int count = (int)((int64_t)frame - first);
+
+    uint8_t packet[NETPLAY_HEADER_SIZE + 2 * NETPLAY_REDUNDANT_INPUTS];
+    packet[0] = NETPLAY_PACKET_MAGIC;
+    packet[1] = (uint8_t)localPlayer;
+    putLittleEndian(packet + 2, (uint32_t)first, 4);
+    packet[6] = (uint8_t)count;
+    putLittleEndian(packet + 7, (uint32_t)confirmedRemoteFrame, 4);
+    putLittleEndian(packet + 11, sentChecksumFrame, 4);
+    putLittleEndian(packet + 15, sentChecksum, 8);
+    for (int i = 0; i < count; i++)
+        putLittleEndian(packet + NETPLAY_HEADER_SIZE + 2 * i, localInputs[(first + i) % NETPLAY_INPUT_WINDOW], 2);
+    channel.send(packet, NETPLAY_HEADER_SIZE + 2 * count);
+}
+
+void rollbackSession::checkChecksums()
+{
+    // a snapshot is final once every input before its frame is confirmed and no rollback is pending
+    while (rollbackFrom < 0 && (int64_t)nextChecksumFrame <= (int64_t)confirmedRemoteFrame + 1 && nextChecksumFrame < frame)
+    {
+        if (nextChecksumFrame + snapshots.size() > frame)
+        {
+            uint64_t checksum = hashState(snapshots[nextChecksumFrame % snapshots.size()], c8.getMemorySize());
+            int slot = (nextChecksumFrame / NETPLAY_CHECKSUM_INTERVAL) % NETPLAY_INPUT_WINDOW;
+            localChecksums[slot] = checksum;
+            localChecksumFrames[slot] = nextChecksumFrame;
+            sentChecksumFrame = nextChecksumFrame;
+            sentChecksum = checksum;
+        }
+        nextChecksumFrame += NETPLAY_CHECKSUM_INTERVAL;
+    }
+
+    if (remoteChecksumFrame == NO_CHECKSUM || remoteChecksumFrame == stats.lastChecksumFrame)
+        return;
+    int slot = (remoteChecksumFrame / NETPLAY_CHECKSUM_INTERVAL) % NETPLAY_INPUT_WINDOW;
+    if (localChecksumFrames[slot] != remoteChecksumFrame)
+        return;
+
+    stats.checksumsCompared++;
+    if (localChecksums[slot] != remoteChecksum)
+        stats.desyncs++;
+    stats.lastChecksumFrame = remoteChecksumFrame;
+    stats.lastChecksum = remoteChecksum;
+}
+
+// re-simulates from the first mispredicted frame with the inputs known now
+void rollbackSession::rollBack()
+{
+    if (rollbackFrom < 0)
+        return;
+
+    uint32_t from = (uint32_t)rollbackFrom;
+    rollbackFrom = -1;
+    c8.loadState(snapshots[from % snapshots.size()]);
+    for (uint32_t f = from; f < frame; f++)
+    {
+        int slot = f % NETPLAY_INPUT_WINDOW;
+        if (remoteFrames[slot] != f)
+            remoteInputs[slot] = predictRemote();
+        if (f != from)
+            c8.saveState(snapshots[f % snapshots.size()]);
+        runFrame(f);
+    }
+
+    stats.rollbacks++;
+    stats.resimulatedFrames += frame - from;
+    if (frame - from > stats.maxRollbackDepth)
+        stats.maxRollbackDepth = frame - from;
+}
+
+bool rollbackSession::advanceFrame(uint16_t localKeys)
+{
+    receivePackets();
+
+    rollBack();
+
+    if ((int64_t)frame - confirmedRemoteFrame > NETPLAY_MAX_ROLLBACK)
+    {
+        stats.stalledFrames++;
+        checkChecksums();
+        sendInputs();
+        return false;
+    }
+
+    int slot = frame % NETPLAY_INPUT_WINDOW;
+    localInputs[slot] = localKeys;
+    if (remoteFrames[slot] != frame)
+        remoteInputs[slot] = predictRemote();
+    c8.saveState(snapshots[frame % snapshots.size()]);
+    runFrame(frame);
+    frame++;
+
+    checkChecksums();
+    sendInputs();
+    return true;
+}
+
+void rollbackSession::poll()
+{
+    receivePackets();
+    rollBack();
+    checkChecksums();
+    sendInputs();
+}
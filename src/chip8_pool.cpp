@@ -0,0 +1,64 @@
+#include "chip8_pool.h"
+#include <cstring>
+
+
+chip8Pool::~chip8Pool()
+{
+    for (std::unordered_map<const chip8*, int>::iterator it = romOf.begin(); it != romOf.end(); ++it)
+        delete it->first;
+}
+
+int chip8Pool::addRom(const uint8_t* data, size_t size, quirkProfile quirks)
+{
+    chip8* instance = new chip8(logger);
+    instance->setQuirkProfile(quirks);
+    if (!instance->loadROM(data, size))
+    {
+        delete instance;
+        return -1;
+    }
+
+    int romId = (int)roms.size();
+    roms.push_back(romImage());
+    romImage& image = roms.back();
+    image.memory.assign(instance->getMemory(), instance->getMemory() + instance->getMemorySize());
+    image.quirks = quirks;
+
+    // the freshly loaded instance is the first free one
+    image.freeInstances.push_back(instance);
+    romOf[instance] = romId;
+    return romId;
+}
+
+chip8* chip8Pool::acquire(int romId, uint32_t seed)
+{
+    romImage& image = roms[romId];
+
+    chip8* instance;
+    if (!image.freeInstances.empty())
+    {
+        instance = image.freeInstances.back();
+        image.freeInstances.pop_back();
+    }
+    else
+    {
+        // a new instance starts as a full copy of the image
+        instance = new chip8(logger);
+        instance->setQuirkProfile(image.quirks);
+        instance->loadROM(&image.memory[0x0200], image.memory.size() - 0x0200);
+        romOf[instance] = romId;
+    }
+
+    instance->reset(image.memory.data(), seed);
+    return instance;
+}
+
+void chip8Pool::reset(chip8* instance, uint32_t seed)
+{
+    instance->reset(roms[romOf[instance]].memory.data(), seed);
+}
+
+void chip8Pool::release(chip8* instance)
+{
+    roms[romOf[instance]].freeInstances.push_back(instance);
+}
@@ -0,0 +1,59 @@
+#include "chip8_quirks.h"
+#include <cstring>
+
+
+template <class Quirks>
+static quirkSettings settingsOf()
+{
+    quirkSettings settings;
+    settings.shiftUsesVY = Quirks::shiftUsesVY;
+    settings.indexIncrement = Quirks::indexIncrement;
+    settings.jumpUsesVX = Quirks::jumpUsesVX;
+    settings.logicResetsVF = Quirks::logicResetsVF;
+    settings.spritesWrap = Quirks::spritesWrap;
+    settings.memoryMask = Quirks::memoryMask;
+    return settings;
+}
+
+quirkSettings getQuirkSettings(quirkProfile profile)
+{
+    switch (profile)
+    {
+        case QUIRKS_COSMAC_VIP: return settingsOf<cosmacVipQuirks>();
+        case QUIRKS_CHIP48:     return settingsOf<chip48Quirks>();
+        case QUIRKS_SUPER_CHIP: return settingsOf<superChipQuirks>();
+        case QUIRKS_XO_CHIP:    return settingsOf<xoChipQuirks>();
+        default:                return settingsOf<modernQuirks>();
+    }
+}
+
+static const char* profileNames[QUIRK_PROFILES_NUMBER] = { "vip", "chip48", "schip", "xochip", "modern" };
+
+const char* getQuirkProfileName(quirkProfile profile)
+{
+    return profile < QUIRK_PROFILES_NUMBER ? profileNames[profile] : "unknown";
+}
+
+bool parseQuirkProfile(const char* name, quirkProfile& profile)
+{
+    for (int i = 0; i < QUIRK_PROFILES_NUMBER; i++)
+    {
+        if (strcmp(name, profileNames[i]) == 0)
+        {
+            profile = (quirkProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t hashRom(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,60 @@
+#include "chip8_rom.h"
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+
+
+bool readRomFile(const char* fileName, std::vector<uint8_t>& rom, chip8Logger* logger)
+{
+    FILE* fp = fopen(fileName, "rb");
+    if (fp == NULL)
+    {
+        if (logger != NULL)
+            logger->log(LOG_ERROR, LOG_ROM_OPEN_FAILED, NULL, 0, 0, 0, fileName);
+        return false;
+    }
+
+    // get the size of file
+    fseek(fp, 0L, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+
+    rom.resize(size > 0 ? size : 0);
+    size_t read = rom.empty() ? 0 : std::fread(&rom[0], sizeof(rom[0]), rom.size(), fp);
+    fclose(fp);
+
+    if (read != rom.size())
+    {
+        if (logger != NULL)
+            logger->log(LOG_ERROR, LOG_ROM_READ_FAILED, NULL, 0, 0, 0, fileName);
+        return false;
+    }
+    if (logger != NULL)
+        logger->log(LOG_INFO, LOG_ROM_OPENED, NULL, 0, 0, (uint32_t)rom.size(), fileName);
+    return true;
+}
+
+bool lookupQuirkProfile(const char* databaseFileName, const uint8_t* data, size_t size, quirkProfile& profile)
+{
+    FILE* fp = fopen(databaseFileName, "r");
+    if (fp == NULL)
+        return false;
+
+    uint64_t romHash = hashRom(data, size);
+    bool found = false;
+    char line[256];
+    while (!found && fgets(line, sizeof(line), fp) != NULL)
+    {
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        uint64_t hash;
+        char name[32];
+        if (sscanf(line, "%" SCNx64 " %31s", &hash, name) == 2 && hash == romHash)
+            found = parseQuirkProfile(name, profile);
+    }
+
+    fclose(fp);
+    return found;
+}
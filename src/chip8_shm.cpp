@@ -0,0 +1,113 @@
+#include "chip8_shm.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_POSIX_SHM
+#endif
+
+
+bool chip8SharedFrame::create(const char* segmentName)
+{
+    close();
+#ifdef HAVE_POSIX_SHM
+    if (strlen(segmentName) >= sizeof(name))
+        return false;
+
+    int fd = shm_open(segmentName, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, sizeof(sharedFrame)) == 0)
+        mapping = mmap(NULL, sizeof(sharedFrame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        shm_unlink(segmentName);
+        return false;
+    }
+
+    segment = (sharedFrame*)mapping;
+    segment->sequence.store(1, std::memory_order_relaxed);     // no frame yet
+    memset(&segment->data, 0, sizeof(segment->data));
+    segment->version = SHARED_FRAME_VERSION;
+    segment->magic = SHARED_FRAME_MAGIC;
+    segment->sequence.store(2, std::memory_order_release);
+
+    strcpy(name, segmentName);
+    owner = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool chip8SharedFrame::open(const char* segmentName)
+{
+    close();
+#ifdef HAVE_POSIX_SHM
+    int fd = shm_open(segmentName, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(sharedFrame))
+        mapping = mmap(NULL, sizeof(sharedFrame), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    segment = (sharedFrame*)mapping;
+    if (segment->magic != SHARED_FRAME_MAGIC || segment->version != SHARED_FRAME_VERSION)
+    {
+        close();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void chip8SharedFrame::close()
+{
+#ifdef HAVE_POSIX_SHM
+    if (segment == NULL)
+        return;
+
+    munmap(segment, sizeof(sharedFrame));
+    if (owner)
+        shm_unlink(name);
+    segment = NULL;
+    owner = false;
+    name[0] = '\0';
+#endif
+}
+
+void chip8SharedFrame::publish(const chip8& c8, uint64_t frame)
+{
+    if (segment == NULL || !owner)
+        return;
+
+    const chip8State& state = c8.getState();
+    sharedFrameData& data = segment->data;
+
+    // seqlock write: odd sequence, stores, even sequence
+    uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    data.frame = frame;
+    data.executedInstructions = state.executedInstructions;
+    data.pc = state.pc;
+    data.I = state.I;
+    memcpy(data.V, state.V, sizeof(data.V));
+    data.delayTimer = state.delayTimer;
+    data.soundTimer = state.soundTimer;
+    data.width = (uint8_t)c8.getDisplayWidth();
+    data.height = (uint8_t)c8.getDisplayHeight();
+    memcpy(data.display, state.display, sizeof(data.display));
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
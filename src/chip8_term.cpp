@@ -0,0 +1,130 @@
+#include "chip8_term.h"
+#include <cstdio>
+#include <cstring>
+
+
+terminalRenderer::terminalRenderer(terminalCellMode cellMode, int row, int column)
+    : mode(cellMode), originRow(row), originColumn(column), width(0), height(0), valid(false)
+{
+    memset(shownRows, 0, sizeof(shownRows));
+
+    // room for a full high resolution redraw, so render() does not allocate after the first frame
+    output.reserve(DISPLAY_HIRES_WIDTH * DISPLAY_HIRES_HEIGHT / 2 * 4 + 1024);
+}
+
+int terminalRenderer::getColumns() const
+{
+    return mode == TERMINAL_BRAILLE ? width / 2 : width;
+}
+
+int terminalRenderer::getRows() const
+{
+    return mode == TERMINAL_BRAILLE ? height / 4 : height / 2;
+}
+
+void terminalRenderer::appendCell(uint8_t code)
+{
+    if (code == 0)
+    {
+        output += ' ';
+        return;
+    }
+
+    if (mode == TERMINAL_HALF_BLOCKS)
+    {
+        // U+2580 upper half, U+2584 lower half, U+2588 full block
+        static const char blocks[4][4] = { " ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88" };
+        output += blocks[code];
+    }
+    else
+    {
+        // U+2800 + dot bits
+        output += (char)0xE2;
+        output += (char)(0xA0 | (code >> 6));
+        output += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+const std::string& terminalRenderer::render(const chip8& c8)
+{
+    output.clear();
+    char move[24];
+
+    bool full = !valid || c8.getDisplayWidth() != width || c8.getDisplayHeight() != height;
+    if (full)
+    {
+        // blank what the previous resolution covered before the cells are redrawn
+        for (int row = 0; valid && row < getRows(); row++)
+        {
+            snprintf(move, sizeof(move), "\x1b[%d;%dH", originRow + row, originColumn);
+            output += move;
+            output.append(getColumns(), ' ');
+        }
+
+        width = c8.getDisplayWidth();
+        height = c8.getDisplayHeight();
+        cells.assign(getColumns() * getRows(), 0);
+        valid = true;
+    }
+
+    int cellWidth = mode == TERMINAL_BRAILLE ? 2 : 1;
+    int cellHeight = mode == TERMINAL_BRAILLE ? 4 : 2;
+    int columns = getColumns();
+    int cursorRow = -1;
+    int cursorColumn = -1;
+
+    uint64_t lit[4][DISPLAY_ROW_WORDS];
+    for (int row = 0; row < getRows(); row++)
+    {
+        // cell rows whose pixel rows are unchanged are skipped without looking at their cells
+        bool changed = full;
+        for (int i = 0; i < cellHeight; i++)
+        {
+            int y = row * cellHeight + i;
+            for (int word = 0; word < DISPLAY_ROW_WORDS; word++)
+            {
+                lit[i][word] = c8.getDisplayRow(0, y)[word] | c8.getDisplayRow(1, y)[word];
+                changed |= lit[i][word] != shownRows[y][word];
+                shownRows[y][word] = lit[i][word];
+            }
+        }
+        if (!changed)
+            continue;
+
+        for (int column = 0; column < columns; column++)
+        {
+            uint8_t code = 0;
+            int x = column * cellWidth;
+            if (mode == TERMINAL_HALF_BLOCKS)
+            {
+                int shift = 63 - (x & 63);
+                code = (uint8_t)(((lit[0][x >> 6] >> shift) & 1) | (((lit[1][x >> 6] >> shift) & 1) << 1));
+            }
+            else
+            {
+                // braille dots 1-2-3-7 are the left column top to bottom, 4-5-6-8 the right one
+                static const uint8_t dots[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+                for (int i = 0; i < 4; i++)
+                    for (int j = 0; j < 2; j++)
+                        if ((lit[i][(x + j) >> 6] >> (63 - ((x + j) & 63))) & 1)
+                            code |= dots[i][j];
+            }
+
+            uint8_t& shown = cells[row * columns + column];
+            if (code == shown && !full)
+                continue;
+            shown = code;
+
+            // consecutive changed cells need no cursor movement in between
+            if (row != cursorRow || column != cursorColumn)
+            {
+                snprintf(move, sizeof(move), "\x1b[%d;%dH", originRow + row, originColumn + column);
+                output += move;
+            }
+            appendCell(code);
+            cursorRow = row;
+            cursorColumn = column + 1;
+        }
+    }
+    return output;
+}
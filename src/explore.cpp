@@ -0,0 +1,113 @@
+// chip8-explore: explores the input sequences of a ROM breadth-first and reports the coverage
+//
+// From the post-load state, every input poll (EX9E, EXA1, FX0A) branches on the keys, and states
+// already reached along another path are dropped. The report counts the distinct states and
+// framebuffers, the program bytes executed, and the pixels ever lit. --uncovered lists the ROM
+// ranges never executed; data tables show up there too.
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_logsink.h"
+#include "chip8_explore.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define EXPLORE_DEFAULT_IPS 1000
+#define EXPLORE_SEED 1
+#define PROGRAM_START 0x200
+
+int main(int argc, char **argv)
+{
+    const char* gameFileName = NULL;
+    quirkProfile quirks = QUIRKS_MODERN;
+    int instructionsPerSecond = EXPLORE_DEFAULT_IPS;
+    bool listUncovered = false;
+    exploreOptions options;
+    options.threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            if (!parseQuirkProfile(argv[i] + 9, quirks))
+            {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--depth=", 8) == 0)
+            options.maxDepth = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--max-states=", 13) == 0)
+            options.maxStates = (size_t)strtoull(argv[i] + 13, NULL, 0);
+        else if (strncmp(argv[i], "--frontier=", 11) == 0)
+            options.maxFrontier = (size_t)strtoull(argv[i] + 11, NULL, 0);
+        else if (strncmp(argv[i], "--segment-frames=", 17) == 0)
+            options.segmentFrames = atoi(argv[i] + 17);
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            options.threads = (unsigned)atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--ips=", 6) == 0)
+            instructionsPerSecond = atoi(argv[i] + 6);
+        else if (strcmp(argv[i], "--uncovered") == 0)
+            listUncovered = true;
+        else
+            gameFileName = argv[i];
+    }
+    if (gameFileName == NULL || instructionsPerSecond <= 0 || options.maxDepth < 0 || options.segmentFrames <= 0
+        || options.maxStates == 0 || options.maxFrontier == 0)
+    {
+        printf("Usage: chip8-explore [--quirks=profile] [--depth=n] [--max-states=n] [--frontier=n] "
+            "[--segment-frames=n] [--threads=n] [--ips=n] [--uncovered] chip8application\n");
+        return 1;
+    }
+    options.cyclesPerFrame = (instructionsPerSecond + 30) / 60;
+
+    std::vector<uint8_t> rom;
+    chip8 myChip8(&getDefaultLogger());
+    myChip8.setQuirkProfile(quirks);
+    if (!readRomFile(gameFileName, rom, &getDefaultLogger()) || !myChip8.loadROM(rom.data(), rom.size()))
+    {
+        fprintf(stderr, "Failed to load the game.\n");
+        return 1;
+    }
+    myChip8.seedRandom(EXPLORE_SEED);
+
+    stateExplorer explorer(options);
+    explorer.explore(myChip8);
+    const exploreStats& stats = explorer.getStats();
+
+    // coverage of the ROM image only, whatever the program executes elsewhere
+    size_t romBytes = 0;
+    for (size_t address = PROGRAM_START; address < PROGRAM_START + rom.size() && address < MEMORY_SIZE; address += 2)
+        if (explorer.isAddressCovered((uint16_t)address))
+            romBytes += 2;
+
+    printf("%d levels, %llu states, %llu duplicates, %llu halted, %llu truncated\n", stats.levels,
+        (unsigned long long)stats.states, (unsigned long long)stats.duplicates, (unsigned long long)stats.halted,
+        (unsigned long long)stats.truncated);
+    printf("%llu branches, %llu instructions in %.2f s (%.1f M instructions/s, %u threads)\n",
+        (unsigned long long)stats.branchesRun, (unsigned long long)stats.instructions, stats.seconds,
+        stats.seconds > 0 ? stats.instructions / stats.seconds / 1e6 : 0.0, options.threads > 0 ? options.threads : 1);
+    printf("coverage: %zu of %zu ROM bytes executed (%.1f%%), %llu distinct frames, %u pixels lit\n",
+        romBytes, rom.size(), rom.empty() ? 0.0 : 100.0 * romBytes / rom.size(),
+        (unsigned long long)stats.distinctFrames, stats.litPixels);
+
+    if (listUncovered)
+    {
+        size_t end = PROGRAM_START + rom.size();
+        for (size_t address = PROGRAM_START; address < end; )
+        {
+            if (explorer.isAddressCovered((uint16_t)address))
+            {
+                address += 2;
+                continue;
+            }
+            size_t first = address;
+            while (address < end && !explorer.isAddressCovered((uint16_t)address))
+                address += 2;
+            printf("not executed: %03zX-%03zX\n", first, (address < end ? address : end) - 1);
+        }
+    }
+    return 0;
+}
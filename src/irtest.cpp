@@ -0,0 +1,227 @@
+// chip8-irtest: checks that the micro-op IR (chip8::executeBlock) and the interpreter agree
+//
+// Two machines run the same program: one block by block through the IR, the other through
+// executeInstructions() for exactly the instructions the block retired. After every block the
+// registers, stack, timers, flags, addressable memory and display must be equal. The programs are
+// the ROM corpus (chip8_corpus.h) under every quirk profile, with its recorded inputs, and random
+// programs built from the opcodes the IR translates, some of them rewriting their own code. Exits
+// with 1 on a mismatch.
+
+#include "chip8.h"
+#include "chip8_corpus.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define IRTEST_RANDOM_PROGRAMS 400          // per quirk profile
+#define IRTEST_RANDOM_INSTRUCTIONS 2000     // each random program runs, most of them in its final loop
+#define IRTEST_RANDOM_SEED 1
+#define IRTEST_MAX_CORPUS_FRAMES 600
+
+static uint32_t randomState = IRTEST_RANDOM_SEED;
+
+// xorshift32, so the programs are the same on every platform
+static uint32_t nextRandom()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// names the first part of the state where the machines differ, NULL if there is none
+static const char* compareStates(const chip8& interpreted, const chip8& translated)
+{
+    const chip8State& a = interpreted.getState();
+    const chip8State& b = translated.getState();
+    if (a.pc != b.pc)
+        return "pc";
+    if (a.I != b.I)
+        return "I";
+    if (memcmp(a.V, b.V, sizeof(a.V)) != 0)
+        return "V";
+    if (a.stackLevel != b.stackLevel || memcmp(a.stack, b.stack, a.stackLevel * sizeof(a.stack[0])) != 0)
+        return "stack";
+    if (a.delayTimer != b.delayTimer || a.soundTimer != b.soundTimer)
+        return "timers";
+    if (a.waitingForKey != b.waitingForKey || a.keyWaitRegister != b.keyWaitRegister || a.halted != b.halted)
+        return "CPU state";
+    if (a.hires != b.hires || a.planeMask != b.planeMask)
+        return "display mode";
+    if (a.randomState != b.randomState)
+        return "random state";
+    if (a.executedInstructions != b.executedInstructions)
+        return "instruction count";
+    if (memcmp(a.rplFlags, b.rplFlags, sizeof(a.rplFlags)) != 0)
+        return "RPL flags";
+    if (memcmp(a.audioPattern, b.audioPattern, sizeof(a.audioPattern)) != 0 || a.pitch != b.pitch)
+        return "audio";
+    if (memcmp(a.memory, b.memory, interpreted.getMemorySize()) != 0)
+        return "memory";
+    if (memcmp(a.display, b.display, sizeof(a.display)) != 0)
+        return "display";
+    return NULL;
+}
+
+// runs blocks until count instructions have retired or the CPU stops, following each with the
+// interpreter; false with the report printed on the first difference
+static bool runBlocks(chip8& interpreted, chip8& translated, uint64_t count, const char* name)
+{
+    uint64_t end = translated.getExecutedInstructions() + count;
+    while (translated.getExecutedInstructions() < end)
+    {
+        uint16_t start = translated.getState().pc;
+        int retired = translated.executeBlock();
+        if (retired == 0)
+            break;
+        interpreted.executeInstructions(retired);
+
+        const char* difference = compareStates(interpreted, translated);
+        if (difference != NULL)
+        {
+            printf("%s: %s differs after the block at 0x%03X (%d instructions)\n", name, difference, start, retired);
+            return false;
+        }
+    }
+    return true;
+}
+
+// plays a corpus session on both machines, with the corpus inputs; the block budget of a frame is
+// the session's instructions per frame
+static bool checkCorpusRom(const corpusRom& rom, quirkProfile quirks)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "corpus:%s on %s", rom.name, getQuirkProfileName(quirks));
+
+    chip8 interpreted, translated;
+    interpreted.setQuirkProfile(quirks);
+    translated.setQuirkProfile(quirks);
+    if (!interpreted.loadROM(rom.data, rom.size) || !translated.loadROM(rom.data, rom.size))
+    {
+        printf("%s: does not load\n", name);
+        return false;
+    }
+    interpreted.seedRandom(CORPUS_SEED);
+    translated.seedRandom(CORPUS_SEED);
+
+    uint32_t frames = rom.frames < IRTEST_MAX_CORPUS_FRAMES ? rom.frames : IRTEST_MAX_CORPUS_FRAMES;
+    size_t nextInput = 0;
+    uint16_t held = 0;
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        // the inputs as playCorpusRom applies them
+        uint32_t time = rom.inputPeriod > 0 ? frame % rom.inputPeriod : frame;
+        if (time == 0)
+        {
+            nextInput = 0;
+            held = 0;
+        }
+        while (nextInput < rom.inputsNumber && rom.inputs[nextInput].frame <= time)
+            held = rom.inputs[nextInput++].keys;
+        const uint8_t* keys = translated.getState().key;
+        for (int k = 0; k < KEYS_NUMBER; k++)
+        {
+            bool pressed = (held >> k) & 1;
+            if ((keys[k] != 0) != pressed)
+            {
+                interpreted.setKey((uint8_t)k, pressed);
+                translated.setKey((uint8_t)k, pressed);
+            }
+        }
+
+        if (!runBlocks(interpreted, translated, rom.cyclesPerFrame, name))
+            return false;
+        interpreted.tickTimers();
+        translated.tickTimers();
+    }
+    return true;
+}
+
+static uint16_t randomOpcode(std::vector<uint16_t>& program)
+{
+    uint16_t x = nextRandom() % 16 << 8;
+    uint16_t y = nextRandom() % 16 << 4;
+    uint16_t nn = nextRandom() & 0xFF;
+    // mostly past the program; a quarter of the addresses are in it, so stores rewrite translated code
+    uint16_t data = (nextRandom() % 4 == 0 ? 0x200 : 0x300) + nextRandom() % 0x100;
+    static const uint16_t arithmetic[] = { 0, 1, 2, 3, 4, 5, 6, 7, 0xE };
+    static const uint16_t screen[] = { 0x00E0, 0x00FB, 0x00FC, 0x00FE, 0x00FF };
+    switch (nextRandom() % 20)
+    {
+        case 0: return 0x6000 | x | nn;
+        case 1: return 0x7000 | x | nn;
+        case 2: return 0x8000 | x | y | arithmetic[nextRandom() % 9];
+        case 3: return 0xA000 | data;
+        case 4: return 0xF01E | x;
+        case 5: return 0xF033 | x;
+        case 6: return 0xF055 | x;
+        case 7: return 0xF065 | x;
+        case 8: return 0xD000 | x | y | (nextRandom() % 16);
+        case 9: return 0x3000 | x | nn;
+        case 10: return 0x4000 | x | nn;
+        case 11: return 0x9000 | x | y;
+        case 12: return 0xF029 | x;
+        case 13: return 0xF007 | x;
+        case 14: return 0x00C0 | (nextRandom() % 16);
+        case 15: return 0x00D0 | (nextRandom() % 16);
+        case 16: return screen[nextRandom() % 5];
+        case 17: return 0x5002 | x | y | (nextRandom() % 2);
+        case 18: return 0xC000 | x | nn;
+        default:
+            // XO-CHIP F000 NNNN, an unknown opcode that halts elsewhere
+            program.push_back(0xF000);
+            return data;
+    }
+}
+
+// a random program that ends in a jump to itself, started with random registers
+static bool checkRandomProgram(quirkProfile quirks, int number)
+{
+    std::vector<uint16_t> program;
+    for (int r = 0; r < REGS_NUMBER; r++)
+        program.push_back(0x6000 | r << 8 | (nextRandom() & 0xFF));
+    program.push_back(0xA300);
+    int length = 10 + nextRandom() % 60;
+    for (int i = 0; i < length; i++)
+    {
+        uint16_t opcode = randomOpcode(program);
+        program.push_back(opcode);
+    }
+    // a skip at the end lands on the second jump
+    uint16_t end = (uint16_t)(0x200 + 2 * program.size());
+    program.push_back(0x1000 | end);
+    program.push_back(0x1000 | (end + 2));
+
+    std::vector<uint8_t> rom;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        rom.push_back((uint8_t)(program[i] >> 8));
+        rom.push_back((uint8_t)program[i]);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "random program %d on %s", number, getQuirkProfileName(quirks));
+    chip8 interpreted, translated;
+    interpreted.setQuirkProfile(quirks);
+    translated.setQuirkProfile(quirks);
+    interpreted.loadROM(rom.data(), rom.size());
+    translated.loadROM(rom.data(), rom.size());
+    interpreted.seedRandom(number + 1);
+    translated.seedRandom(number + 1);
+    return runBlocks(interpreted, translated, IRTEST_RANDOM_INSTRUCTIONS, name);
+}
+
+int main()
+{
+    int passed = 0, failed = 0;
+    for (int profile = 0; profile < QUIRK_PROFILES_NUMBER; profile++)
+    {
+        for (int i = 0; i < CORPUS_ROMS_NUMBER; i++)
+            checkCorpusRom(corpusRoms[i], (quirkProfile)profile) ? passed++ : failed++;
+        for (int i = 0; i < IRTEST_RANDOM_PROGRAMS; i++)
+            checkRandomProgram((quirkProfile)profile, i) ? passed++ : failed++;
+    }
+    printf("%d passed, %d failed\n", passed, failed);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+// chip8-latencytest: checks that inputLatencyTracker (--latency of Main) times a key press through a
+// program that polls the key and draws on it, and that report() prints the figures
+//
+// The timestamps are made up: the press at 0, the changed frame 1 ms later and the swap 1.5 ms after
+// the press, so the report must show one sample of 1.00 ms and one of 0.50 ms. Exits with 1 on a
+// mismatch, printing the report.
+
+#include "chip8.h"
+#include "chip8_latency.h"
+#include <cstdio>
+#include <cstring>
+
+#define LATENCYTEST_CYCLES_PER_FRAME 16
+
+// waits for key 0 (EX9E), then draws the font glyph of V0
+static const uint8_t pollAndDraw[] =
+{
+    0x60, 0x00,     // 0x200: V0 = 0
+    0xE0, 0x9E,     // 0x202: skip if key V0 is down
+    0x12, 0x02,     // 0x204: jump 0x202
+    0xF0, 0x29,     // 0x206: I = glyph of V0
+    0xD0, 0x15,     // 0x208: draw it at V0, V1
+    0x12, 0x0A      // 0x20A: jump 0x20A
+};
+
+int main()
+{
+    chip8 c8;
+    if (!c8.loadROM(pollAndDraw, sizeof(pollAndDraw)))
+        return 1;
+
+    inputLatencyTracker tracker;
+    c8.executeInstructions(LATENCYTEST_CYCLES_PER_FRAME);
+    tracker.onFrame(0, c8);
+    tracker.onPresented(0);
+
+    tracker.onKeyPressed(0, c8);
+    c8.setKey(0, true);
+    c8.executeInstructions(LATENCYTEST_CYCLES_PER_FRAME);
+    tracker.onFrame(1000000, c8);
+    tracker.onPresented(1500000);
+
+    FILE* output = tmpfile();
+    if (output == NULL)
+        return 1;
+    tracker.report(output);
+    char report[512];
+    rewind(output);
+    size_t length = fread(report, 1, sizeof(report) - 1, output);
+    fclose(output);
+    report[length] = '\0';
+
+    const char* expected[] =
+    {
+        "key to changed frame        1 samples, p50 1.00 ms, p99 1.00 ms",
+        "frame to swap               1 samples, p50 0.50 ms, p99 0.50 ms"
+    };
+    bool passed = true;
+    for (int i = 0; i < 2; i++)
+        if (strstr(report, expected[i]) == NULL)
+        {
+            printf("missing \"%s\"\n", expected[i]);
+            passed = false;
+        }
+    if (!passed)
+        printf("report:\n%s", report);
+    return passed ? 0 : 1;
+}
@@ -1,49 +1,235 @@
 #include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_logsink.h"
+#include "chip8_audio_out.h"
+#include "chip8_capture.h"
+#include "chip8_shm.h"
+#include "chip8_clock.h"
+#include "chip8_latency.h"
+#include "chip8_input.h"
 #include "GL/glut.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
 #include <iostream>
-#include <chrono>
-#include <thread>
 
 
-// Display size
-#define SCREEN_WIDTH 64
-#define SCREEN_HEIGHT 32
+// Display size; the texture always holds the 128x64 high resolution
+#define SCREEN_WIDTH 128
+#define SCREEN_HEIGHT 64
 
-chip8 myChip8;
+chip8 myChip8(&getDefaultLogger());
 int modifier = 10;
 
+// Sound: tickTimers renders the samples, display() hands them to the selected output
+chip8Audio myAudio;
+nullAudioSink silentOutput;
+hostAudioSink speakerOutput;
+wavAudioSink wavOutput;
+audioSink* audioOutput = &silentOutput;
+
+// Video recording of every emulated 60 Hz frame
+chip8Capture myCapture;
+
+// Frames published to other processes (--shm); frameCounter counts the 60 Hz frames
+chip8SharedFrame sharedOutput;
+uint64_t frameCounter = 0;
+
 // Window size
-int display_width = SCREEN_WIDTH * modifier;
-int display_height = SCREEN_HEIGHT * modifier;
+int display_width = DISPLAY_LORES_WIDTH * modifier;
+int display_height = DISPLAY_LORES_HEIGHT * modifier;
 
 void display();
 void reshape_window(GLsizei w, GLsizei h);
 void keyboardUp(unsigned char key, int x, int y);
 void keyboardDown(unsigned char key, int x, int y);
 
+// Host keys are translated through keyMapping (--keymap=file); the transitions reach the core
+// through inputEvents, between two instructions
+keyMap keyMapping;
+inputQueue inputEvents;
+
+// Emulation runs in 60 Hz frames: a batch of instructions, then the delay and sound timers.
+// The pacer hands out the frames that are due on the wall clock, or back to back with --clock=virtual.
+#define DEFAULT_INSTRUCTIONS_PER_SECOND 1000
+realTimeClock wallClock;
+virtualClock fastClock;
+framePacer* pacer = NULL;
+int cyclesPerFrame = (DEFAULT_INSTRUCTIONS_PER_SECOND + 30) / 60;
+bool idleRegistered = false;
+void setIdle(bool enabled);
+
+// Fast-forward (Tab): turboSpeed times the frame rate, 0 = uncapped, with audio muted and only
+// every frameSkip-th frame presented
+bool turbo = false;
+double turboSpeed = 0;
+int frameSkip = 4;
+uint64_t nextPresentedFrame = 0;
+void setTurbo(bool enabled);
+
+// Input-to-photon measurement (--latency), on the wall clock whatever paces the frames
+bool measureLatency = false;
+inputLatencyTracker latencyTracker;
+void reportLatency();
+
 // Use new drawing method
 #define DRAWWITHTEXTURE
 typedef unsigned __int8 u8;
 u8 screenData[SCREEN_HEIGHT][SCREEN_WIDTH][3]; 
+const u8 palette[4] = { 0, 255, 170, 85 };  // colors of the XO-CHIP plane combinations
 void setupTexture();
 
 
 int main(int argc, char **argv) 
 {		
-	if(argc < 2)
+	const char* gameFileName = NULL;
+	const char* romDatabase = "romdb.txt";
+	const char* audioMode = "host";
+	const char* captureSpec = NULL;
+	int captureScale = 4;
+	const char* sharedName = NULL;
+	bool virtualTime = false;
+	bool startTurbo = false;
+	int instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND;
+	quirkProfile quirks = QUIRKS_MODERN;
+	bool quirksGiven = false;
+	const char* keyMapName = NULL;
+	for(int i = 1; i < argc; i++)
 	{
-		printf("Usage: myChip8.exe chip8application\n\n");
+		if(strncmp(argv[i], "--quirks=", 9) == 0)
+		{
+			if(!parseQuirkProfile(argv[i] + 9, quirks))
+			{
+				std::cerr << "Unknown quirk profile " << argv[i] + 9 << " (vip, chip48, schip, xochip, modern).\n";
+				return 1;
+			}
+			quirksGiven = true;
+		}
+		else if(strncmp(argv[i], "--romdb=", 8) == 0)
+			romDatabase = argv[i] + 8;
+		else if(strncmp(argv[i], "--audio=", 8) == 0)
+			audioMode = argv[i] + 8;
+		else if(strncmp(argv[i], "--capture=", 10) == 0)
+			captureSpec = argv[i] + 10;
+		else if(strncmp(argv[i], "--capture-scale=", 16) == 0)
+			captureScale = atoi(argv[i] + 16);
+		else if(strncmp(argv[i], "--shm=", 6) == 0)
+			sharedName = argv[i] + 6;
+		else if(strcmp(argv[i], "--clock=virtual") == 0)
+			virtualTime = true;
+		else if(strcmp(argv[i], "--clock=realtime") == 0)
+			virtualTime = false;
+		else if(strncmp(argv[i], "--ips=", 6) == 0)
+			instructionsPerSecond = atoi(argv[i] + 6);
+		else if(strncmp(argv[i], "--speed=", 8) == 0)
+		{
+			turboSpeed = strcmp(argv[i] + 8, "max") == 0 ? 0 : atof(argv[i] + 8);
+			startTurbo = true;
+		}
+		else if(strncmp(argv[i], "--keymap=", 9) == 0)
+			keyMapName = argv[i] + 9;
+		else if(strcmp(argv[i], "--latency") == 0)
+			measureLatency = true;
+		else if(strncmp(argv[i], "--frameskip=", 12) == 0)
+			frameSkip = atoi(argv[i] + 12) > 0 ? atoi(argv[i] + 12) : 1;
+		else
+			gameFileName = argv[i];
+	}
+
+	if(gameFileName == NULL || instructionsPerSecond <= 0)
+	{
+		printf("Usage: myChip8.exe [--quirks=vip|chip48|schip|xochip|modern] [--romdb=file] [--audio=host|none|wav:file] [--capture=raw|y4m|ppm:file] [--capture-scale=n] [--shm=/name] [--clock=realtime|virtual] [--ips=n] [--speed=n|max] [--frameskip=k] [--latency] [--keymap=file] chip8application\n");
+		printf("--audio=host plays through waveOut on Windows; elsewhere it falls back to none (wav:file records the sound)\n\n");
 		return 1;
 	}
 
-	// Load game
-	if (!myChip8.loadGame(argv[1]))
+	// Load game; the quirk profile comes from the flag, else from the ROM database
+	std::vector<uint8_t> rom;
+	if(!readRomFile(gameFileName, rom, &getDefaultLogger()))
+	{
+		std::cerr << "Failed to load the game.\n";
+		return 0;
+	}
+	if(!quirksGiven)
+		lookupQuirkProfile(romDatabase, rom.data(), rom.size(), quirks);
+	printf("Quirk profile: %s\n", getQuirkProfileName(quirks));
+
+	myChip8.setQuirkProfile(quirks);
+	if (!myChip8.loadROM(rom.data(), rom.size()))
 	{
 		std::cerr << "Failed to load the game.\n";
 		return 0;
 	};
+	myChip8.seedRandom((uint32_t)time(0));
+
+	// Setup sound; without an audio device the emulator runs silently
+	if(strncmp(audioMode, "wav:", 4) == 0)
+	{
+		if(!wavOutput.open(audioMode + 4, myAudio.getSampleRate()))
+		{
+			std::cerr << "Failed to create " << audioMode + 4 << ".\n";
+			return 1;
+		}
+		audioOutput = &wavOutput;
+	}
+	else if(strcmp(audioMode, "host") == 0)
+	{
+		if(speakerOutput.open(myAudio.getSampleRate()))
+			audioOutput = &speakerOutput;
+		else
+			printf("No host audio device (waveOut, Windows only), sound is off\n");
+	}
+	else if(strcmp(audioMode, "none") != 0)
+	{
+		std::cerr << "Unknown audio output " << audioMode << " (host, none, wav:file).\n";
+		return 1;
+	}
+	myChip8.setAudio(&myAudio);
+
+	// Setup recording; a ppm file name is a pattern such as frame%05u.ppm
+	if(captureSpec != NULL)
+	{
+		char formatName[8] = "";
+		const char* separator = strchr(captureSpec, ':');
+		captureFormat format;
+		if(separator != NULL && separator - captureSpec < (int)sizeof(formatName))
+			strncat(formatName, captureSpec, separator - captureSpec);
+		if(separator == NULL || !parseCaptureFormat(formatName, format))
+		{
+			std::cerr << "Unknown capture " << captureSpec << " (raw:file, y4m:file, ppm:pattern).\n";
+			return 1;
+		}
+		if(!myCapture.open(separator + 1, format, captureScale))
+		{
+			std::cerr << "Failed to start the capture to " << separator + 1 << ".\n";
+			return 1;
+		}
+	}
+
+	// Setup the shared-memory export
+	if(sharedName != NULL && !sharedOutput.create(sharedName))
+	{
+		std::cerr << "Failed to create the shared memory segment " << sharedName << ".\n";
+		return 1;
+	}
 		
+	// Setup the keyboard
+	if(keyMapName != NULL && !keyMapping.load(keyMapName))
+	{
+		std::cerr << "Failed to read the key map " << keyMapName << ".\n";
+		return 1;
+	}
+
+	// Setup the latency report; it is printed however the program ends, Esc or the window closed
+	if(measureLatency)
+		atexit(reportLatency);
+
+	// Setup pacing
+	cyclesPerFrame = (instructionsPerSecond + 30) / 60;
+	pacer = new framePacer(virtualTime ? (hostClock&)fastClock : (hostClock&)wallClock);
+
 	// Setup OpenGL
 	glutInit(&argc, argv);          
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
@@ -53,7 +239,8 @@ int main(int argc, char **argv)
 	glutCreateWindow("myChip8");
 	
 	glutDisplayFunc(display);
-	glutIdleFunc(display);
+	setIdle(true);
+	setTurbo(startTurbo);
     glutReshapeFunc(reshape_window);        
 	glutKeyboardFunc(keyboardDown);
 	glutKeyboardUpFunc(keyboardUp); 
@@ -90,13 +277,11 @@ void setupTexture()
 
 void updateTexture(const chip8& c8)
 {	
-	// Update pixels
-	for(int y = 0; y < 32; ++y)		
-		for(int x = 0; x < 64; ++x)
-			if(c8.displayScreen[(y * 64) + x] == 0)
-				screenData[y][x][0] = screenData[y][x][1] = screenData[y][x][2] = 0;	// Disabled
-			else 
-				screenData[y][x][0] = screenData[y][x][1] = screenData[y][x][2] = 255;  // Enabled
+	// Update pixels; a low resolution pixel covers 2x2 texels
+	int scale = SCREEN_WIDTH / c8.getDisplayWidth();
+	for(int y = 0; y < SCREEN_HEIGHT; ++y)		
+		for(int x = 0; x < SCREEN_WIDTH; ++x)
+			screenData[y][x][0] = screenData[y][x][1] = screenData[y][x][2] = palette[c8.getPixel(x / scale, y / scale)];
 		
 	// Update Texture
 	glTexSubImage2D(GL_TEXTURE_2D, 0 ,0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)screenData);
@@ -110,37 +295,85 @@ void updateTexture(const chip8& c8)
 }
 
 // Old gfx code
-void drawPixel(int x, int y)
+void drawPixel(int x, int y, float size)
 {
 	glBegin(GL_QUADS);
-		glVertex3f((x * modifier) + 0.0f,     (y * modifier) + 0.0f,	 0.0f);
-		glVertex3f((x * modifier) + 0.0f,     (y * modifier) + modifier, 0.0f);
-		glVertex3f((x * modifier) + modifier, (y * modifier) + modifier, 0.0f);
-		glVertex3f((x * modifier) + modifier, (y * modifier) + 0.0f,	 0.0f);
+		glVertex3f((x * size) + 0.0f, (y * size) + 0.0f, 0.0f);
+		glVertex3f((x * size) + 0.0f, (y * size) + size, 0.0f);
+		glVertex3f((x * size) + size, (y * size) + size, 0.0f);
+		glVertex3f((x * size) + size, (y * size) + 0.0f, 0.0f);
 	glEnd();
 }
 
 void updateQuads(const chip8& c8)
 {
 	// Draw
-	for(int y = 0; y < 32; ++y)		
-		for(int x = 0; x < 64; ++x)
+	float size = (float)modifier * DISPLAY_LORES_WIDTH / c8.getDisplayWidth();
+	for(int y = 0; y < c8.getDisplayHeight(); ++y)		
+		for(int x = 0; x < c8.getDisplayWidth(); ++x)
 		{
-			if(c8.displayScreen[(y * 64) + x] == 0) 
-				glColor3f(0.0f,0.0f,0.0f);			
-			else 
-				glColor3f(1.0f,1.0f,1.0f);
+			float level = palette[c8.getPixel(x, y)] / 255.0f;
+			glColor3f(level, level, level);
 
-			drawPixel(x, y);
+			drawPixel(x, y, size);
 		}
 }
 
+void setIdle(bool enabled)
+{
+	if(enabled == idleRegistered)
+		return;
+
+	// while unregistered GLUT blocks in its event loop until the next window or key event
+	glutIdleFunc(enabled ? display : NULL);
+	idleRegistered = enabled;
+	if(enabled)
+		pacer->restart();
+}
+
+void setTurbo(bool enabled)
+{
+	turbo = enabled;
+	pacer->setSpeed(enabled ? turboSpeed : 1.0);
+
+	// muted: no samples are rendered, so the audio device only runs dry
+	myChip8.setAudio(enabled ? NULL : &myAudio);
+	glutSetWindowTitle(enabled ? "myChip8 (turbo)" : "myChip8");
+}
+
 void display()
 {
-	myChip8.executeCycle();
-		
-	if(myChip8.drawFlag)
+	// Run the frames that are due; the pacer sleeps until the first one is
+	int frames = pacer->waitForFrames();
+	for(int frame = 0; frame < frames; frame++)
 	{
+		// input is applied between cycles; a cycle may retire up to FUSED_MAX_INSTRUCTIONS instructions
+		uint64_t frameEnd = myChip8.getExecutedInstructions() + cyclesPerFrame;
+		while(myChip8.getExecutedInstructions() < frameEnd)
+		{
+			if(!inputEvents.isEmpty())
+				inputEvents.apply(myChip8);
+			if(myChip8.isHalted() || myChip8.isWaitingForKey())
+				break;
+			uint64_t remaining = frameEnd - myChip8.getExecutedInstructions();
+			myChip8.executeCycle(remaining < FUSED_MAX_INSTRUCTIONS ? (int)remaining : FUSED_MAX_INSTRUCTIONS);
+		}
+		myChip8.tickTimers();
+		myCapture.submit(myChip8);
+		frameCounter++;
+		if(measureLatency)
+			latencyTracker.onFrame(wallClock.now(), myChip8);
+	}
+	myAudio.pump(*audioOutput);
+
+	// readers of the segment see every display() call, whether or not the frame is presented
+	sharedOutput.publish(myChip8, frameCounter);
+
+	// in turbo only every frameSkip-th frame is converted and presented; the rest stay pending
+	if(myChip8.drawFlag && (!turbo || frameCounter >= nextPresentedFrame))
+	{
+		nextPresentedFrame = frameCounter + frameSkip;
+
 		// Clear framebuffer
 		glClear(GL_COLOR_BUFFER_BIT);
         
@@ -152,11 +385,23 @@ void display()
 
 		// Swap buffers!
 		glutSwapBuffers();    
+		if(measureLatency)
+			latencyTracker.onPresented(wallClock.now());
 
 		// Processed frame
 		myChip8.drawFlag = false;
 	}
-	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	if(myChip8.isHalted())
+	{
+		// unknown opcode or 00FD; only a restart gets the program going again
+		setIdle(false);
+		return;
+	}
+
+	// FX0A with the timers stopped: nothing changes until a key event, so stop polling
+	if(myChip8.isWaitingForKey() && !myChip8.areTimersActive())
+		setIdle(false);
 }
 
 void reshape_window(GLsizei w, GLsizei h)
@@ -173,53 +418,59 @@ void reshape_window(GLsizei w, GLsizei h)
 	display_height = h;
 }
 
+void reportLatency()
+{
+	latencyTracker.report(stdout);
+	fflush(stdout);
+}
+
 void keyboardDown(unsigned char key, int x, int y)
 {
-	if(key == 27)    // esc
-		exit(0);
+	if(key == '\t')
+	{
+		setTurbo(!turbo);
+		return;
+	}
 
-	if(key == '1')		myChip8.key[0x1] = 1;
-	else if(key == '2')	myChip8.key[0x2] = 1;
-	else if(key == '3')	myChip8.key[0x3] = 1;
-	else if(key == '4')	myChip8.key[0xC] = 1;
+	if(key == 27)    // esc
+	{
+		uint64_t executed = myChip8.getExecutedInstructions();
+		uint64_t fused = myChip8.getFusedInstructions();
+		printf("Executed %llu instructions, %.1f%% fused\n", (unsigned long long)executed,
+			executed ? 100.0 * fused / executed : 0.0);
+		pacingStats pacing = pacer->getStats();
+		printf("%llu frames, %llu dropped; wake-up lateness %.0f us mean, %.0f us jitter, %.0f us max; CPU %.0f%%\n",
+			(unsigned long long)pacing.frames, (unsigned long long)pacing.droppedFrames, pacing.meanLateness,
+			pacing.jitter, pacing.maxLateness, 100.0 * pacing.cpuUsage);
+		sharedOutput.close();
+		if(myCapture.isOpen())
+		{
+			myCapture.close();
+			printf("Captured %llu frames, %llu dropped%s\n", (unsigned long long)myCapture.getWrittenFrames(),
+				(unsigned long long)myCapture.getDroppedFrames(), myCapture.hasFailed() ? ", write error" : "");
+		}
+		exit(0);    // prints the latency report (reportLatency)
+	}
 
-	else if(key == 'q')	myChip8.key[0x4] = 1;
-	else if(key == 'w')	myChip8.key[0x5] = 1;
-	else if(key == 'e')	myChip8.key[0x6] = 1;
-	else if(key == 'r')	myChip8.key[0xD] = 1;
+	int keyIndex = keyMapping.lookup(key);
+	if(keyIndex < 0)
+		return;
 
-	else if(key == 'a')	myChip8.key[0x7] = 1;
-	else if(key == 's')	myChip8.key[0x8] = 1;
-	else if(key == 'd')	myChip8.key[0x9] = 1;
-	else if(key == 'f')	myChip8.key[0xE] = 1;
+	// timed from here: the core reads the key no earlier than the next instruction boundary
+	uint64_t now = wallClock.now();
+	if(measureLatency)
+		latencyTracker.onKeyPressed(now, myChip8);
+	inputEvents.push(now, (uint8_t)keyIndex, true);
 
-	else if(key == 'z')	myChip8.key[0xA] = 1;
-	else if(key == 'x')	myChip8.key[0x0] = 1;
-	else if(key == 'c')	myChip8.key[0xB] = 1;
-	else if(key == 'v')	myChip8.key[0xF] = 1;
+	// The CPU may be waiting in FX0A; polling resumes so the event gets applied
+	setIdle(true);
 
 	//printf("Press key %c\n", key);
 }
 
 void keyboardUp(unsigned char key, int x, int y)
 {
-	if(key == '1')		myChip8.key[0x1] = 0;
-	else if(key == '2')	myChip8.key[0x2] = 0;
-	else if(key == '3')	myChip8.key[0x3] = 0;
-	else if(key == '4')	myChip8.key[0xC] = 0;
-
-	else if(key == 'q')	myChip8.key[0x4] = 0;
-	else if(key == 'w')	myChip8.key[0x5] = 0;
-	else if(key == 'e')	myChip8.key[0x6] = 0;
-	else if(key == 'r')	myChip8.key[0xD] = 0;
-
-	else if(key == 'a')	myChip8.key[0x7] = 0;
-	else if(key == 's')	myChip8.key[0x8] = 0;
-	else if(key == 'd')	myChip8.key[0x9] = 0;
-	else if(key == 'f')	myChip8.key[0xE] = 0;
-
-	else if(key == 'z')	myChip8.key[0xA] = 0;
-	else if(key == 'x')	myChip8.key[0x0] = 0;
-	else if(key == 'c')	myChip8.key[0xB] = 0;
-	else if(key == 'v')	myChip8.key[0xF] = 0;
+	int keyIndex = keyMapping.lookup(key);
+	if(keyIndex >= 0)
+		inputEvents.push(wallClock.now(), (uint8_t)keyIndex, false);
 }
@@ -0,0 +1,259 @@
+// chip8-netplay: two players on one keypad over UDP, with rollback
+//
+// Each player runs a copy of this tool against the other's address, e.g. on one machine:
+//     chip8-netplay --player=0 --port=7000 --peer=127.0.0.1:7001 game.ch8
+//     chip8-netplay --player=1 --port=7001 --peer=127.0.0.1:7000 game.ch8
+// --latency and --loss impair the outgoing packets to try the rollback without a real network.
+// With --term the display is drawn in the terminal and played from the keyboard (keys held for
+// NETPLAY_KEY_HOLD_FRAMES frames, as in chip8-term); otherwise --input=random:seed drives the
+// keys, which together with --frames gives a headless desync test. At the end the session keeps
+// exchanging packets until both sides confirmed every frame, then prints the statistics and the
+// last compared checksum, which must be the same on both sides.
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_logsink.h"
+#include "chip8_netplay.h"
+#include "chip8_term.h"
+#include "chip8_clock.h"
+#include "chip8_input.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <termios.h>
+#include <unistd.h>
+
+#define NETPLAY_KEY_HOLD_FRAMES 6
+#define NETPLAY_DEFAULT_IPS 1000
+#define NETPLAY_DEFAULT_SEED 1
+#define NETPLAY_LINGER_FRAMES 300       // frames to wait for the peer after the last one
+#define NETPLAY_REPEAT_FRAMES 30        // frames to keep sending once both sides are done
+
+static volatile sig_atomic_t quitRequested = 0;
+static struct termios savedTerminal;
+
+static void onInterrupt(int)
+{
+    quitRequested = 1;
+}
+
+static void writeAll(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written <= 0)
+            return;
+        data += written;
+        size -= written;
+    }
+}
+
+static void restoreTerminal()
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &savedTerminal);
+    const char* reset = "\x1b[0m\x1b[?25h\n";
+    writeAll(reset, strlen(reset));
+}
+
+// scripted player: about every other tenth of a second one random key is held, a function of the
+// frame only, so a stalled frame does not change the input
+static uint16_t randomKeys(uint32_t seed, uint32_t frame)
+{
+    uint32_t x = seed * 0x9E3779B9u + frame / 6 + 1;
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return (x & 31) < KEYS_NUMBER ? (uint16_t)(1 << (x & 31)) : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char* gameFileName = NULL;
+    quirkProfile quirks = QUIRKS_MODERN;
+    int instructionsPerSecond = NETPLAY_DEFAULT_IPS;
+    int player = -1;
+    int localPort = 0;
+    std::string peerHost;
+    int peerPort = 0;
+    int latency = 0;
+    double loss = 0;
+    long frames = 0;                // 0 - until Ctrl-C
+    bool randomInput = false;
+    uint32_t inputSeed = 0;
+    uint32_t seed = NETPLAY_DEFAULT_SEED;
+    bool terminal = false;
+    keyMap keyMapping;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            if (!parseQuirkProfile(argv[i] + 9, quirks))
+            {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--keymap=", 9) == 0)
+        {
+            if (!keyMapping.load(argv[i] + 9))
+            {
+                fprintf(stderr, "Failed to read the key map %s\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--player=", 9) == 0)
+            player = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--port=", 7) == 0)
+            localPort = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--peer=", 7) == 0)
+        {
+            const char* colon = strrchr(argv[i] + 7, ':');
+            if (colon != NULL)
+            {
+                peerHost.assign(argv[i] + 7, colon - (argv[i] + 7));
+                peerPort = atoi(colon + 1);
+            }
+        }
+        else if (strncmp(argv[i], "--latency=", 10) == 0)
+            latency = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--loss=", 7) == 0)
+            loss = atof(argv[i] + 7) / 100;
+        else if (strncmp(argv[i], "--frames=", 9) == 0)
+            frames = atol(argv[i] + 9);
+        else if (strncmp(argv[i], "--input=random:", 15) == 0)
+        {
+            randomInput = true;
+            inputSeed = (uint32_t)strtoul(argv[i] + 15, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            seed = (uint32_t)strtoul(argv[i] + 7, NULL, 0);
+        else if (strncmp(argv[i], "--ips=", 6) == 0)
+            instructionsPerSecond = atoi(argv[i] + 6);
+        else if (strcmp(argv[i], "--term") == 0)
+            terminal = true;
+        else
+            gameFileName = argv[i];
+    }
+    if (gameFileName == NULL || (player != 0 && player != 1) || localPort <= 0 || peerPort <= 0
+        || instructionsPerSecond <= 0 || latency < 0 || loss < 0 || loss > 1)
+    {
+        printf("Usage: chip8-netplay --player=0|1 --port=n --peer=host:port [--latency=ms] [--loss=percent] "
+            "[--frames=n] [--input=random:seed | --term [--keymap=file]] [--seed=n] [--quirks=profile] [--ips=n] "
+            "chip8application\n");
+        return 1;
+    }
+
+    // both peers must start from the same state: same ROM, quirks and CXNN seed
+    std::vector<uint8_t> rom;
+    chip8 myChip8(&getDefaultLogger());
+    myChip8.setQuirkProfile(quirks);
+    if (!readRomFile(gameFileName, rom, &getDefaultLogger()) || !myChip8.loadROM(rom.data(), rom.size()))
+    {
+        fprintf(stderr, "Failed to load the game.\n");
+        return 1;
+    }
+    myChip8.seedRandom(seed);
+
+    udpChannel channel;
+    if (!channel.open((uint16_t)localPort, peerHost.c_str(), (uint16_t)peerPort))
+    {
+        fprintf(stderr, "Failed to open UDP port %d to %s:%d\n", localPort, peerHost.c_str(), peerPort);
+        return 1;
+    }
+    channel.setImpairment((uint32_t)latency, loss, seed + player);
+    rollbackSession session(myChip8, channel, player, (instructionsPerSecond + 30) / 60);
+
+    terminalRenderer renderer(TERMINAL_HALF_BLOCKS);
+    if (terminal)
+    {
+        tcgetattr(STDIN_FILENO, &savedTerminal);
+        struct termios raw = savedTerminal;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        atexit(restoreTerminal);
+        const char* setup = "\x1b[2J\x1b[?25l";
+        writeAll(setup, strlen(setup));
+    }
+    signal(SIGINT, onInterrupt);
+
+    int keyFrames[KEYS_NUMBER] = { 0 };
+    uint16_t heldKeys = 0;
+
+    // one session frame per host frame; a stalled frame is not caught up later, the session
+    // simply runs that much later than the wall clock
+    realTimeClock wallClock;
+    framePacer pacer(wallClock, CLOCK_FRAME_PERIOD_NS, 1);
+    while (!quitRequested && (frames == 0 || session.getFrame() < (uint32_t)frames))
+    {
+        pacer.waitForFrames();
+
+        if (terminal)
+        {
+            char input[64];
+            ssize_t count = read(STDIN_FILENO, input, sizeof(input));
+            for (ssize_t i = 0; i < count; i++)
+            {
+                int keyIndex = keyMapping.lookup((unsigned char)input[i]);
+                if (keyIndex >= 0)
+                    keyFrames[keyIndex] = NETPLAY_KEY_HOLD_FRAMES;
+            }
+            heldKeys = 0;
+            for (int keyIndex = 0; keyIndex < KEYS_NUMBER; keyIndex++)
+                if (keyFrames[keyIndex] > 0)
+                    heldKeys |= 1 << keyIndex;
+        }
+        else if (randomInput)
+            heldKeys = randomKeys(inputSeed + player, session.getFrame());
+
+        if (!session.advanceFrame(heldKeys))
+            continue;
+
+        for (int keyIndex = 0; keyIndex < KEYS_NUMBER; keyIndex++)
+            if (keyFrames[keyIndex] > 0)
+                keyFrames[keyIndex]--;
+
+        if (terminal && myChip8.drawFlag)
+        {
+            const std::string& update = renderer.render(myChip8);
+            writeAll(update.data(), update.size());
+            myChip8.drawFlag = false;
+        }
+    }
+
+    // let the peer catch up so that both sides compare the same final checksum; once done, keep
+    // repeating the last packet for a while in case it is lost
+    uint32_t lastFrame = session.getFrame() - 1;
+    int remaining = NETPLAY_LINGER_FRAMES;
+    bool settled = false;
+    for (; remaining > 0 && !quitRequested; remaining--)
+    {
+        pacer.waitForFrames();
+        session.poll();
+        if (!settled && session.getConfirmedFrame() >= (int32_t)lastFrame && session.isRemoteAcknowledged(lastFrame)
+            && session.getStats().lastChecksumFrame + NETPLAY_CHECKSUM_INTERVAL > lastFrame)
+        {
+            settled = true;
+            remaining = remaining < NETPLAY_REPEAT_FRAMES ? remaining : NETPLAY_REPEAT_FRAMES;
+        }
+    }
+
+    const netplayStats& stats = session.getStats();
+    char status[512];
+    snprintf(status, sizeof(status), "%s%u frames, %llu stalled; %llu rollbacks, %llu frames re-simulated, "
+        "deepest %u; %llu of %llu packets dropped; %llu checksums compared, %llu desyncs; last frame %u hash %016llx\n",
+        terminal ? "\x1b[0m\n" : "", session.getFrame(), (unsigned long long)stats.stalledFrames,
+        (unsigned long long)stats.rollbacks, (unsigned long long)stats.resimulatedFrames, stats.maxRollbackDepth,
+        (unsigned long long)channel.getLostPackets(), (unsigned long long)channel.getSentPackets(),
+        (unsigned long long)stats.checksumsCompared, (unsigned long long)stats.desyncs,
+        stats.lastChecksumFrame, (unsigned long long)stats.lastChecksum);
+    writeAll(status, strlen(status));
+    return stats.desyncs == 0 ? 0 : 2;
+}
@@ -0,0 +1,418 @@
+// chip8-regress: replays ROMs headless on every core and compares framebuffer hashes with a manifest
+//
+// Manifest lines, '#' starts a comment; paths are relative to the manifest:
+//     <rom> <quirk profile> <input script or -> <frame> <hash> [reference.ppm]
+// A rom of "corpus:<name>" is the program of that name in the bench corpus (chip8_corpus.h).
+// An input script has "<frame> <key in hex> <1 = press | 0 = release>" lines, applied before that
+// frame runs. A frame retires REGRESS_CYCLES_PER_FRAME instructions, a superinstruction counting
+// as each instruction it fuses, followed by one tickTimers(); the hash is taken after the given
+// number of frames. Mismatches are written as PPM images next to
+// the manifest; with a reference image, a diff marks pixels missing in red and extra in green.
+// --update prints the manifest with the hashes of this run and rewrites the reference images.
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_logsink.h"
+#include "chip8_pool.h"
+#include "chip8_corpus.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define REGRESS_CYCLES_PER_FRAME 16     // the 1 kHz instruction rate of Main
+#define REGRESS_SEED 1                  // CXNN sequence of every run
+#define REGRESS_IMAGE_SCALE 4
+
+struct keyEvent
+{
+    uint32_t frame;
+    uint8_t key;
+    bool pressed;
+};
+
+struct testCase
+{
+    int line;
+    int rom;            // index into the loaded ROMs
+    int script;         // index into the loaded input scripts, -1 for none
+    quirkProfile quirks;
+    uint32_t frame;
+    uint64_t expected;
+    std::string reference;
+};
+
+struct testResult
+{
+    uint64_t actual;
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;    // plane colors, kept for mismatches and --update only
+};
+
+static const uint8_t levels[4] = { 0, 255, 170, 85 };
+
+static std::string resolvePath(const std::string& base, const char* path)
+{
+    if (path[0] == '/' || path[0] == '\\' || (path[0] != '\0' && path[1] == ':'))
+        return path;
+    return base + path;
+}
+
+// "corpus:<name>" names a program of the bench corpus, anything else a file
+static bool loadRom(const std::string& name, std::vector<uint8_t>& data)
+{
+    if (name.compare(0, 7, "corpus:") != 0)
+        return readRomFile(name.c_str(), data, &getDefaultLogger());
+
+    for (int i = 0; i < CORPUS_ROMS_NUMBER; i++)
+        if (name.compare(7, std::string::npos, corpusRoms[i].name) == 0)
+        {
+            data.assign(corpusRoms[i].data, corpusRoms[i].data + corpusRoms[i].size);
+            return true;
+        }
+    fprintf(stderr, "No ROM %s in the corpus\n", name.c_str() + 7);
+    return false;
+}
+
+static bool loadScript(const std::string& fileName, std::vector<keyEvent>& events)
+{
+    FILE* fp = fopen(fileName.c_str(), "r");
+    if (fp == NULL)
+        return false;
+
+    char line[128];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        unsigned frame, key, pressed;
+        if (sscanf(line, "%u %x %u", &frame, &key, &pressed) == 3 && key < KEYS_NUMBER)
+        {
+            keyEvent event = { frame, (uint8_t)key, pressed != 0 };
+            events.push_back(event);
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+// FNV-1a of the resolution and the visible part of both planes, leftmost pixel first
+static uint64_t hashDisplay(const chip8& c8)
+{
+    uint8_t bytes[2 + DISPLAY_PLANES * DISPLAY_HIRES_HEIGHT * DISPLAY_ROW_WORDS * 8];
+    size_t size = 0;
+    int width = c8.getDisplayWidth();
+    int height = c8.getDisplayHeight();
+    bytes[size++] = (uint8_t)width;
+    bytes[size++] = (uint8_t)height;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+        for (int y = 0; y < height; y++)
+            for (int word = 0; word < width / 64; word++)
+            {
+                uint64_t bits = c8.getDisplayRow(plane, y)[word];
+                for (int i = 7; i >= 0; i--)
+                    bytes[size++] = (uint8_t)(bits >> (8 * i));
+            }
+    return hashRom(bytes, size);
+}
+
+static bool writeImage(const std::string& fileName, const testResult& result, const std::vector<uint8_t>* expected)
+{
+    FILE* fp = fopen(fileName.c_str(), "wb");
+    if (fp == NULL)
+        return false;
+
+    int scale = REGRESS_IMAGE_SCALE;
+    fprintf(fp, "P6\n%d %d\n255\n", result.width * scale, result.height * scale);
+    std::vector<uint8_t> row(result.width * scale * 3);
+    for (int y = 0; y < result.height; y++)
+    {
+        for (int x = 0; x < result.width; x++)
+        {
+            uint8_t actual = result.pixels[y * result.width + x];
+            uint8_t rgb[3] = { levels[actual], levels[actual], levels[actual] };
+            if (expected != NULL)
+            {
+                uint8_t wanted = (*expected)[y * result.width + x];
+                if (actual == wanted)
+                    rgb[0] = rgb[1] = rgb[2] = levels[actual] / 3;    // unchanged pixels are dimmed
+                else
+                {
+                    rgb[0] = wanted != 0 ? 255 : 0;     // red: expected pixel is missing
+                    rgb[1] = actual != 0 ? 255 : 0;     // green: extra pixel; yellow: other plane
+                    rgb[2] = 0;
+                }
+            }
+            for (int i = 0; i < scale; i++)
+                memcpy(&row[(x * scale + i) * 3], rgb, 3);
+        }
+        for (int i = 0; i < scale; i++)
+            fwrite(row.data(), 1, row.size(), fp);
+    }
+    return fclose(fp) == 0;
+}
+
+// reads a PPM written by writeImage (any integer scale) back into plane colors
+static bool readImage(const std::string& fileName, int width, int height, std::vector<uint8_t>& pixels)
+{
+    FILE* fp = fopen(fileName.c_str(), "rb");
+    if (fp == NULL)
+        return false;
+
+    int imageWidth, imageHeight, maximum;
+    bool valid = fscanf(fp, "P6 %d %d %d", &imageWidth, &imageHeight, &maximum) == 3 && fgetc(fp) != EOF
+        && maximum == 255 && imageWidth % width == 0 && imageWidth / width > 0 && imageHeight == imageWidth / width * height;
+    std::vector<uint8_t> image;
+    if (valid)
+    {
+        image.resize((size_t)imageWidth * imageHeight * 3);
+        valid = fread(image.data(), 1, image.size(), fp) == image.size();
+    }
+    fclose(fp);
+    if (!valid)
+        return false;
+
+    int scale = imageWidth / width;
+    pixels.resize(width * height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t level = image[((size_t)y * scale * imageWidth + x * scale) * 3];
+            int color = 0;
+            for (int i = 1; i < 4; i++)
+                if (abs(level - levels[i]) < abs(level - levels[color]))
+                    color = i;
+            pixels[y * width + x] = (uint8_t)color;
+        }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char* manifestName = NULL;
+    bool update = false;
+    unsigned threadsNumber = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            threadsNumber = (unsigned)atoi(argv[i] + 10);
+        else
+            manifestName = argv[i];
+    }
+    if (manifestName == NULL)
+    {
+        printf("Usage: chip8-regress [--update] [--threads=n] manifest\n");
+        return 2;
+    }
+    if (threadsNumber == 0)
+        threadsNumber = 1;
+
+    FILE* manifest = fopen(manifestName, "r");
+    if (manifest == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", manifestName);
+        return 2;
+    }
+    std::string base(manifestName);
+    base.erase(base.find_last_of("/\\") == std::string::npos ? 0 : base.find_last_of("/\\") + 1);
+
+    // every ROM and script is read once, however many entries use it
+    std::vector<std::string> romNames, scriptNames;
+    std::vector<std::vector<uint8_t>> roms;
+    std::vector<std::vector<keyEvent>> scripts;
+    std::vector<testCase> cases;
+    std::vector<std::string> manifestLines;     // rewritten by --update
+    bool loadFailed = false;
+
+    char line[1024];
+    for (int lineNumber = 1; fgets(line, sizeof(line), manifest) != NULL; lineNumber++)
+    {
+        manifestLines.push_back(line);
+        manifestLines.back().erase(manifestLines.back().find_last_not_of("\r\n") + 1);
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char romName[512], profileName[32], scriptName[512], reference[512] = "";
+        unsigned frame;
+        uint64_t expected;
+        int fields = sscanf(line, "%511s %31s %511s %u %" SCNx64 " %511s", romName, profileName, scriptName,
+            &frame, &expected, reference);
+        if (fields <= 0)
+            continue;
+
+        testCase entry;
+        entry.line = lineNumber;
+        entry.frame = frame;
+        entry.expected = expected;
+        if (fields < 5 || !parseQuirkProfile(profileName, entry.quirks))
+        {
+            fprintf(stderr, "%s:%d: malformed entry\n", manifestName, lineNumber);
+            loadFailed = true;
+            continue;
+        }
+        if (fields == 6)
+            entry.reference = resolvePath(base, reference);
+
+        std::string romPath = strncmp(romName, "corpus:", 7) == 0 ? std::string(romName) : resolvePath(base, romName);
+        for (entry.rom = 0; entry.rom < (int)romNames.size() && romNames[entry.rom] != romPath; entry.rom++)
+            ;
+        if (entry.rom == (int)romNames.size())
+        {
+            romNames.push_back(romPath);
+            roms.push_back(std::vector<uint8_t>());
+            if (!loadRom(romPath, roms.back()))
+                loadFailed = true;
+        }
+
+        entry.script = -1;
+        if (strcmp(scriptName, "-") != 0)
+        {
+            std::string scriptPath = resolvePath(base, scriptName);
+            for (entry.script = 0; entry.script < (int)scriptNames.size() && scriptNames[entry.script] != scriptPath; entry.script++)
+                ;
+            if (entry.script == (int)scriptNames.size())
+            {
+                scriptNames.push_back(scriptPath);
+                scripts.push_back(std::vector<keyEvent>());
+                if (!loadScript(scriptPath, scripts.back()))
+                {
+                    fprintf(stderr, "Failed to open %s\n", scriptPath.c_str());
+                    loadFailed = true;
+                }
+            }
+        }
+        cases.push_back(entry);
+    }
+    fclose(manifest);
+    if (loadFailed)
+        return 2;
+
+    // workers pull entries off a shared counter; each has its own pool, so a ROM is loaded once
+    // per thread and every later run of it only undoes what the previous run dirtied
+    std::vector<testResult> results(cases.size());
+    std::atomic<size_t> nextCase(0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threadsNumber; t++)
+        workers.push_back(std::thread([&]
+        {
+            chip8Pool pool(&getDefaultLogger());
+            std::vector<int> poolIds(roms.size() * QUIRK_PROFILES_NUMBER, -1);
+            for (size_t i = nextCase++; i < cases.size(); i = nextCase++)
+            {
+                const testCase& entry = cases[i];
+                int& romId = poolIds[entry.rom * QUIRK_PROFILES_NUMBER + entry.quirks];
+                if (romId < 0)
+                    romId = pool.addRom(roms[entry.rom].data(), roms[entry.rom].size(), entry.quirks);
+                testResult& result = results[i];
+                chip8* c8 = romId >= 0 ? pool.acquire(romId, REGRESS_SEED) : NULL;
+                if (c8 == NULL)
+                {
+                    result.actual = 0;
+                    result.width = result.height = 0;
+                    continue;
+                }
+
+                size_t event = 0;
+                const std::vector<keyEvent>* script = entry.script >= 0 ? &scripts[entry.script] : NULL;
+                for (uint32_t frame = 0; frame < entry.frame; frame++)
+                {
+                    for (; script != NULL && event < script->size(); event++)
+                    {
+                        const keyEvent& input = (*script)[event];
+                        if (input.frame > frame)
+                            break;
+                        if (input.frame == frame)
+                            c8->setKey(input.key, input.pressed);
+                    }
+                    c8->executeInstructions(REGRESS_CYCLES_PER_FRAME);
+                    c8->tickTimers();
+                }
+
+                result.actual = hashDisplay(*c8);
+                result.width = c8->getDisplayWidth();
+                result.height = c8->getDisplayHeight();
+                if (update || result.actual != entry.expected)
+                {
+                    result.pixels.resize(result.width * result.height);
+                    for (int y = 0; y < result.height; y++)
+                        for (int x = 0; x < result.width; x++)
+                            result.pixels[y * result.width + x] = c8->getPixel(x, y);
+                }
+                pool.release(c8);
+            }
+        }));
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int failed = 0;
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        const testCase& entry = cases[i];
+        const testResult& result = results[i];
+        if (update)
+        {
+            // the manifest line with the new hash; the reference image is rewritten to match
+            char hash[17];
+            snprintf(hash, sizeof(hash), "%016" PRIx64, result.actual);
+            std::string& text = manifestLines[entry.line - 1];
+            size_t column = 0;
+            for (int field = 0; field < 4; field++)
+            {
+                column = text.find_first_not_of(" \t", column);
+                column = text.find_first_of(" \t", column);
+            }
+            column = text.find_first_not_of(" \t", column);
+            text.replace(column, text.find_first_of(" \t#", column) - column, hash);
+            if (!entry.reference.empty() && result.width > 0)
+                writeImage(entry.reference, result, NULL);
+            continue;
+        }
+        if (result.actual == entry.expected)
+            continue;
+
+        failed++;
+        if (result.width == 0)
+        {
+            printf("%s:%d: %s could not be loaded\n", manifestName, entry.line, romNames[entry.rom].c_str());
+            continue;
+        }
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "line%d", entry.line);
+        std::string imageName = base + prefix + "-actual.ppm";
+        writeImage(imageName, result, NULL);
+        printf("%s:%d: %s frame %u: expected %016" PRIx64 ", got %016" PRIx64 " (%s", manifestName, entry.line,
+            romNames[entry.rom].c_str(), entry.frame, entry.expected, result.actual, imageName.c_str());
+
+        std::vector<uint8_t> expected;
+        if (!entry.reference.empty() && readImage(entry.reference, result.width, result.height, expected))
+        {
+            std::string diffName = base + prefix + "-diff.ppm";
+            writeImage(diffName, result, &expected);
+            printf(", %s", diffName.c_str());
+        }
+        printf(")\n");
+    }
+
+    if (update)
+    {
+        for (size_t i = 0; i < manifestLines.size(); i++)
+            printf("%s\n", manifestLines[i].c_str());
+        return 0;
+    }
+    printf("%d passed, %d failed in %.2f s on %u threads\n", (int)cases.size() - failed, failed, seconds, threadsNumber);
+    return failed > 0 ? 1 : 0;
+}
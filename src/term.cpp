@@ -0,0 +1,168 @@
+// chip8-term: runs a ROM in the terminal, e.g. over SSH or in a tmux pane
+//
+// The display is redrawn only where it changed, with one write per frame. Terminals report key
+// presses but no releases, so a key stays down for TERMINAL_KEY_HOLD_FRAMES frames after its last
+// press (auto-repeat keeps it down while held). Ctrl-C quits and prints the pacing statistics.
+
+#include "chip8.h"
+#include "chip8_rom.h"
+#include "chip8_logsink.h"
+#include "chip8_term.h"
+#include "chip8_clock.h"
+#include "chip8_input.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <csignal>
+#include <vector>
+#include <termios.h>
+#include <unistd.h>
+
+#define TERMINAL_KEY_HOLD_FRAMES 6
+#define TERMINAL_DEFAULT_IPS 1000
+
+static volatile sig_atomic_t quitRequested = 0;
+static struct termios savedTerminal;
+
+static void onInterrupt(int)
+{
+    quitRequested = 1;
+}
+
+static void writeAll(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written <= 0)
+            return;
+        data += written;
+        size -= written;
+    }
+}
+
+static void restoreTerminal()
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &savedTerminal);
+    const char* reset = "\x1b[0m\x1b[?25h\n";
+    writeAll(reset, strlen(reset));
+}
+
+int main(int argc, char **argv)
+{
+    const char* gameFileName = NULL;
+    quirkProfile quirks = QUIRKS_MODERN;
+    terminalCellMode cellMode = TERMINAL_HALF_BLOCKS;
+    int instructionsPerSecond = TERMINAL_DEFAULT_IPS;
+    bool virtualTime = false;
+    keyMap keyMapping;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            if (!parseQuirkProfile(argv[i] + 9, quirks))
+            {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--keymap=", 9) == 0)
+        {
+            if (!keyMapping.load(argv[i] + 9))
+            {
+                fprintf(stderr, "Failed to read the key map %s\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--braille") == 0)
+            cellMode = TERMINAL_BRAILLE;
+        else if (strcmp(argv[i], "--clock=virtual") == 0)
+            virtualTime = true;
+        else if (strcmp(argv[i], "--clock=realtime") == 0)
+            virtualTime = false;
+        else if (strncmp(argv[i], "--ips=", 6) == 0)
+            instructionsPerSecond = atoi(argv[i] + 6);
+        else
+            gameFileName = argv[i];
+    }
+    if (gameFileName == NULL || instructionsPerSecond <= 0)
+    {
+        printf("Usage: chip8-term [--quirks=profile] [--braille] [--clock=realtime|virtual] [--ips=n] [--keymap=file] chip8application\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> rom;
+    chip8 myChip8(&getDefaultLogger());
+    myChip8.setQuirkProfile(quirks);
+    if (!readRomFile(gameFileName, rom, &getDefaultLogger()) || !myChip8.loadROM(rom.data(), rom.size()))
+    {
+        fprintf(stderr, "Failed to load the game.\n");
+        return 1;
+    }
+    myChip8.seedRandom((uint32_t)time(0));
+
+    // raw, non-blocking input; the screen is cleared once and the cursor hidden
+    tcgetattr(STDIN_FILENO, &savedTerminal);
+    struct termios raw = savedTerminal;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    atexit(restoreTerminal);
+    signal(SIGINT, onInterrupt);
+    const char* setup = "\x1b[2J\x1b[?25l";
+    writeAll(setup, strlen(setup));
+
+    terminalRenderer renderer(cellMode);
+    int keyFrames[KEYS_NUMBER] = { 0 };     // frames a key stays pressed
+
+    // whole frames: instructions of one 60 Hz period, the timers, then at most one redraw
+    realTimeClock wallClock;
+    virtualClock fastClock;
+    framePacer pacer(virtualTime ? (hostClock&)fastClock : (hostClock&)wallClock);
+    int cyclesPerFrame = (instructionsPerSecond + 30) / 60;
+    while (!quitRequested)
+    {
+        int frames = pacer.waitForFrames();
+
+        char input[64];
+        ssize_t count = read(STDIN_FILENO, input, sizeof(input));
+        for (ssize_t i = 0; i < count; i++)
+        {
+            int keyIndex = keyMapping.lookup((unsigned char)input[i]);
+            if (keyIndex < 0)
+                continue;
+            if (keyFrames[keyIndex] == 0)
+                myChip8.setKey((uint8_t)keyIndex, true);
+            keyFrames[keyIndex] = TERMINAL_KEY_HOLD_FRAMES;
+        }
+
+        for (int frame = 0; frame < frames; frame++)
+        {
+            myChip8.executeInstructions(cyclesPerFrame);
+            myChip8.tickTimers();
+
+            for (int keyIndex = 0; keyIndex < KEYS_NUMBER; keyIndex++)
+                if (keyFrames[keyIndex] > 0 && --keyFrames[keyIndex] == 0)
+                    myChip8.setKey((uint8_t)keyIndex, false);
+        }
+
+        if (myChip8.drawFlag)
+        {
+            const std::string& update = renderer.render(myChip8);
+            writeAll(update.data(), update.size());
+            myChip8.drawFlag = false;
+        }
+    }
+
+    // leave the cursor below the display
+    char status[256];
+    pacingStats pacing = pacer.getStats();
+    snprintf(status, sizeof(status), "\x1b[%d;1H%llu frames, %llu dropped; wake-up lateness %.0f us mean, "
+        "%.0f us jitter, %.0f us max; CPU %.0f%%", renderer.getRows() + 1, (unsigned long long)pacing.frames,
+        (unsigned long long)pacing.droppedFrames, pacing.meanLateness, pacing.jitter, pacing.maxLateness,
+        100.0 * pacing.cpuUsage);
+    writeAll(status, strlen(status));
+    return 0;
+}